@@ -1,5 +1,48 @@
 
 #include <math.h>
+#include <string.h>
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+#include <emmintrin.h>
+#define FALLOFF_SSE2
+#endif
+// With GCC or Clang on x86 the kernels also come in AVX2 and AVX-512 forms,
+// compiled in whatever -march says, and simdLevel picks one at startup
+#if defined(FALLOFF_SSE2) && defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define SIMD_DISPATCH
+// AVX-512 brings FMA along; GCC would fuse the separate mul and add
+#ifdef __clang__
+#define SIMD_TARGET(isa) __attribute__((target(isa)))
+#else
+#define SIMD_TARGET(isa) __attribute__((target(isa), optimize("fp-contract=off")))
+#endif
+#endif
+
+// Widest instructions the vector kernels (falloff_n, flipped_n) may use
+enum SimdLevel {
+    SIMD_SCALAR,
+    SIMD_SSE2,
+    SIMD_AVX2,
+    SIMD_AVX512
+};
+const char *const simdNames[] = { "scalar", "sse2", "avx2", "avx512" };
+
+// Best level this CPU and build support (CPUID, and OS support of the registers)
+inline SimdLevel simd_detect() {
+#ifdef SIMD_DISPATCH
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) return SIMD_AVX512;
+    if (__builtin_cpu_supports("avx2")) return SIMD_AVX2;
+#endif
+#ifdef FALLOFF_SSE2
+    return SIMD_SSE2;
+#else
+    return SIMD_SCALAR;
+#endif
+}
+
+// Level in use; lowered with -I to compare the kernels
+SimdLevel simdLevel = simd_detect();
 
 
 // const double pi = 3.14159265358979323846;
@@ -44,6 +87,282 @@ double x, double y, double z, double x0, double y0, double z0, double radius=def
     return 1.0-(*func)(x, y, z, x0, y0, z0, radius, scale);
 }
 
+//
+// Array forms of the functions above. Positions come in as separate x, y, z arrays (SoA)
+// and n results are written to out. Everything that depends only on the function
+// parameters is computed once in make_falloff.
+//
+
+enum FalloffKind {
+    FALLOFF_CONSTANT,
+    FALLOFF_GAUSSIAN,
+    FALLOFF_TRIANGULAR,
+    FALLOFF_SQUARE
+};
+
+struct Falloff {
+    int kind;
+    double x0, y0, z0;
+    double radius2;  // squared distance bounding the inside (triangular, square)
+    double k;        // gaussian: log(scale)/radius^2, triangular: |radius/scale|
+    double a, b;     // inside value is a + b*f, f being exp(..) or d/radius
+    double outside;  // value outside radius2
+};
+
+Falloff make_falloff(double (*func)(double, double, double, double, double, double, double, double, bool),
+double x0, double y0, double z0, double radius=def_radius, double scale=def_scale, bool neg=false) {
+    Falloff f;
+    f.x0 = x0; f.y0 = y0; f.z0 = z0;
+    f.radius2 = 0; f.k = 0;
+    f.a = 0; f.b = 0;
+    f.outside = neg ? 0 : 1;
+    if (func == gaussian) {
+        if (scale <= 1.0) { scale = 2.0; }
+        f.kind = FALLOFF_GAUSSIAN;
+        f.k = log(scale) / (radius*radius);
+        f.a = neg ? 0 : 1; f.b = neg ? 1 : -1;
+    } else if (func == triangular) {
+        if (scale == 0) { scale = 1.0; }
+        double scaledRadius = fabs(radius / scale);
+        f.kind = FALLOFF_TRIANGULAR;
+        f.radius2 = scaledRadius*scaledRadius;
+        f.k = scaledRadius;
+        f.a = neg ? 1 : 0; f.b = neg ? -1 : 1;
+    } else if (func == square) {
+        if (fabs(scale) > 1) { scale = scale/fabs(scale); }
+        f.kind = FALLOFF_SQUARE;
+        f.radius2 = radius < 0 ? -1 : radius*radius;
+        f.a = neg ? scale : 1.0-scale;
+    } else {
+        f.kind = FALLOFF_CONSTANT;
+    }
+    return f;
+}
+
+// exp(x) for x <= 0: 2^n * poly(r), r = x - n*ln2, |r| <= ln2/2; within 2 ulp of exp()
+inline double falloff_exp(double x) {
+    const double magic = 6755399441055744.0; // 1.5*2^52, rounds to integer
+    if (x < -708.0) x = -708.0;
+    double t = x*1.4426950408889634 + magic;
+    double n = t - magic;
+    double r = (x - n*6.93147180369123816490e-01) - n*1.90821492927058770002e-10;
+    double p = 1.0/479001600;
+    p = p*r + 1.0/39916800; p = p*r + 1.0/3628800; p = p*r + 1.0/362880;
+    p = p*r + 1.0/40320;    p = p*r + 1.0/5040;    p = p*r + 1.0/720;
+    p = p*r + 1.0/120;      p = p*r + 1.0/24;      p = p*r + 1.0/6;
+    p = p*r + 0.5;          p = p*r + 1.0;         p = p*r + 1.0;
+    t = t + 1023;
+    unsigned long long bits;
+    memcpy(&bits, &t, sizeof(bits));
+    bits <<= 52;
+    double scale;
+    memcpy(&scale, &bits, sizeof(scale));
+    return p*scale;
+}
+
+#ifdef FALLOFF_SSE2
+inline __m128d falloff_exp_pd(__m128d x) {
+    const __m128d magic = _mm_set1_pd(6755399441055744.0);
+    x = _mm_max_pd(x, _mm_set1_pd(-708.0));
+    __m128d t = _mm_add_pd(_mm_mul_pd(x, _mm_set1_pd(1.4426950408889634)), magic);
+    __m128d n = _mm_sub_pd(t, magic);
+    __m128d r = _mm_sub_pd(_mm_sub_pd(x, _mm_mul_pd(n, _mm_set1_pd(6.93147180369123816490e-01))),
+                           _mm_mul_pd(n, _mm_set1_pd(1.90821492927058770002e-10)));
+    __m128d p = _mm_set1_pd(1.0/479001600);
+    p = _mm_add_pd(_mm_mul_pd(p, r), _mm_set1_pd(1.0/39916800));
+    p = _mm_add_pd(_mm_mul_pd(p, r), _mm_set1_pd(1.0/3628800));
+    p = _mm_add_pd(_mm_mul_pd(p, r), _mm_set1_pd(1.0/362880));
+    p = _mm_add_pd(_mm_mul_pd(p, r), _mm_set1_pd(1.0/40320));
+    p = _mm_add_pd(_mm_mul_pd(p, r), _mm_set1_pd(1.0/5040));
+    p = _mm_add_pd(_mm_mul_pd(p, r), _mm_set1_pd(1.0/720));
+    p = _mm_add_pd(_mm_mul_pd(p, r), _mm_set1_pd(1.0/120));
+    p = _mm_add_pd(_mm_mul_pd(p, r), _mm_set1_pd(1.0/24));
+    p = _mm_add_pd(_mm_mul_pd(p, r), _mm_set1_pd(1.0/6));
+    p = _mm_add_pd(_mm_mul_pd(p, r), _mm_set1_pd(0.5));
+    p = _mm_add_pd(_mm_mul_pd(p, r), _mm_set1_pd(1.0));
+    p = _mm_add_pd(_mm_mul_pd(p, r), _mm_set1_pd(1.0));
+    t = _mm_add_pd(t, _mm_set1_pd(1023));
+    __m128d scale = _mm_castsi128_pd(_mm_slli_epi64(_mm_castpd_si128(t), 52));
+    return _mm_mul_pd(p, scale);
+}
+
+// where mask is set take a, otherwise b
+inline __m128d falloff_select_pd(__m128d mask, __m128d a, __m128d b) {
+    return _mm_or_pd(_mm_and_pd(mask, a), _mm_andnot_pd(mask, b));
+}
+#endif
+
+#ifdef SIMD_DISPATCH
+// falloff_exp_pd four and eight at a time; mul and add stay separate (no FMA)
+// so every level gives the same bits
+SIMD_TARGET("avx2") inline __m256d falloff_exp_pd4(__m256d x) {
+    const __m256d magic = _mm256_set1_pd(6755399441055744.0);
+    x = _mm256_max_pd(x, _mm256_set1_pd(-708.0));
+    __m256d t = _mm256_add_pd(_mm256_mul_pd(x, _mm256_set1_pd(1.4426950408889634)), magic);
+    __m256d n = _mm256_sub_pd(t, magic);
+    __m256d r = _mm256_sub_pd(_mm256_sub_pd(x, _mm256_mul_pd(n, _mm256_set1_pd(6.93147180369123816490e-01))),
+                              _mm256_mul_pd(n, _mm256_set1_pd(1.90821492927058770002e-10)));
+    static const double c[] = { 1.0/39916800, 1.0/3628800, 1.0/362880, 1.0/40320, 1.0/5040, 1.0/720,
+                                1.0/120, 1.0/24, 1.0/6, 0.5, 1.0, 1.0 };
+    __m256d p = _mm256_set1_pd(1.0/479001600);
+    for (int i = 0; i < 12; i++) p = _mm256_add_pd(_mm256_mul_pd(p, r), _mm256_set1_pd(c[i]));
+    t = _mm256_add_pd(t, _mm256_set1_pd(1023));
+    __m256d scale = _mm256_castsi256_pd(_mm256_slli_epi64(_mm256_castpd_si256(t), 52));
+    return _mm256_mul_pd(p, scale);
+}
+
+// The AVX-512 kernels use the zero-masked (maskz) forms where the plain
+// intrinsic would pass an undefined vector through, which GCC warns about
+SIMD_TARGET("avx512f") inline __m512d falloff_exp_pd8(__m512d x) {
+    const __m512d magic = _mm512_set1_pd(6755399441055744.0);
+    x = _mm512_maskz_max_pd(0xff, x, _mm512_set1_pd(-708.0));
+    __m512d t = _mm512_add_pd(_mm512_mul_pd(x, _mm512_set1_pd(1.4426950408889634)), magic);
+    __m512d n = _mm512_sub_pd(t, magic);
+    __m512d r = _mm512_sub_pd(_mm512_sub_pd(x, _mm512_mul_pd(n, _mm512_set1_pd(6.93147180369123816490e-01))),
+                              _mm512_mul_pd(n, _mm512_set1_pd(1.90821492927058770002e-10)));
+    static const double c[] = { 1.0/39916800, 1.0/3628800, 1.0/362880, 1.0/40320, 1.0/5040, 1.0/720,
+                                1.0/120, 1.0/24, 1.0/6, 0.5, 1.0, 1.0 };
+    __m512d p = _mm512_set1_pd(1.0/479001600);
+    for (int i = 0; i < 12; i++) p = _mm512_add_pd(_mm512_mul_pd(p, r), _mm512_set1_pd(c[i]));
+    t = _mm512_add_pd(t, _mm512_set1_pd(1023));
+    __m512d scale = _mm512_castsi512_pd(_mm512_maskz_slli_epi64(0xff, _mm512_castpd_si512(t), 52));
+    return _mm512_mul_pd(p, scale);
+}
+#endif
+
+// Squared distance to the falloff center
+inline double falloff_distance2(const Falloff &f, double x, double y, double z) {
+    double dx = x - f.x0, dy = y - f.y0, dz = z - f.z0;
+    return dx*dx + dy*dy + dz*dz;
+}
+
+// Scalar body of falloff_n; the vector paths do the same operations 2, 4 or 8 points at a time
+inline double falloff_at(const Falloff &f, double x, double y, double z) {
+    double d2 = falloff_distance2(f, x, y, z);
+    switch (f.kind) {
+    case FALLOFF_GAUSSIAN:
+        return f.a + f.b*falloff_exp(-d2*f.k);
+    case FALLOFF_TRIANGULAR:
+        return d2 < f.radius2 ? f.a + f.b*(sqrt(d2)/f.k) : f.outside;
+    case FALLOFF_SQUARE:
+        return d2 <= f.radius2 ? f.a : f.outside;
+    }
+    return 0;
+}
+
+#ifdef SIMD_DISPATCH
+// falloff_n four points at a time; the kind is not constant
+SIMD_TARGET("avx2") void falloff_n_avx2(const Falloff &f, const double *x, const double *y, const double *z, int n, double *out) {
+    int i = 0;
+    const __m256d x0 = _mm256_set1_pd(f.x0), y0 = _mm256_set1_pd(f.y0), z0 = _mm256_set1_pd(f.z0);
+    const __m256d r2 = _mm256_set1_pd(f.radius2), k = _mm256_set1_pd(f.k);
+    const __m256d a = _mm256_set1_pd(f.a), b = _mm256_set1_pd(f.b), outside = _mm256_set1_pd(f.outside);
+    for (; i + 4 <= n; i += 4) {
+        __m256d dx = _mm256_sub_pd(_mm256_loadu_pd(x+i), x0);
+        __m256d dy = _mm256_sub_pd(_mm256_loadu_pd(y+i), y0);
+        __m256d dz = _mm256_sub_pd(_mm256_loadu_pd(z+i), z0);
+        __m256d d2 = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(dx, dx), _mm256_mul_pd(dy, dy)), _mm256_mul_pd(dz, dz));
+        __m256d v;
+        if (f.kind == FALLOFF_GAUSSIAN) {
+            v = _mm256_add_pd(a, _mm256_mul_pd(b, falloff_exp_pd4(_mm256_mul_pd(_mm256_sub_pd(_mm256_setzero_pd(), d2), k))));
+        } else if (f.kind == FALLOFF_TRIANGULAR) {
+            v = _mm256_add_pd(a, _mm256_mul_pd(b, _mm256_div_pd(_mm256_sqrt_pd(d2), k)));
+            v = _mm256_blendv_pd(outside, v, _mm256_cmp_pd(d2, r2, _CMP_LT_OQ));
+        } else {
+            v = _mm256_blendv_pd(outside, a, _mm256_cmp_pd(d2, r2, _CMP_LE_OQ));
+        }
+        _mm256_storeu_pd(out+i, v);
+    }
+    for (; i < n; i++) out[i] = falloff_at(f, x[i], y[i], z[i]);
+}
+
+// falloff_n eight points at a time, the last few under a mask
+SIMD_TARGET("avx512f") void falloff_n_avx512(const Falloff &f, const double *x, const double *y, const double *z, int n, double *out) {
+    const __m512d x0 = _mm512_set1_pd(f.x0), y0 = _mm512_set1_pd(f.y0), z0 = _mm512_set1_pd(f.z0);
+    const __m512d r2 = _mm512_set1_pd(f.radius2), k = _mm512_set1_pd(f.k);
+    const __m512d a = _mm512_set1_pd(f.a), b = _mm512_set1_pd(f.b), outside = _mm512_set1_pd(f.outside);
+    for (int i = 0; i < n; i += 8) {
+        __mmask8 live = n - i >= 8 ? 0xff : (1 << (n - i)) - 1;
+        __m512d dx = _mm512_sub_pd(_mm512_maskz_loadu_pd(live, x+i), x0);
+        __m512d dy = _mm512_sub_pd(_mm512_maskz_loadu_pd(live, y+i), y0);
+        __m512d dz = _mm512_sub_pd(_mm512_maskz_loadu_pd(live, z+i), z0);
+        __m512d d2 = _mm512_add_pd(_mm512_add_pd(_mm512_mul_pd(dx, dx), _mm512_mul_pd(dy, dy)), _mm512_mul_pd(dz, dz));
+        __m512d v;
+        if (f.kind == FALLOFF_GAUSSIAN) {
+            v = _mm512_add_pd(a, _mm512_mul_pd(b, falloff_exp_pd8(_mm512_mul_pd(_mm512_sub_pd(_mm512_setzero_pd(), d2), k))));
+        } else if (f.kind == FALLOFF_TRIANGULAR) {
+            v = _mm512_add_pd(a, _mm512_mul_pd(b, _mm512_div_pd(_mm512_maskz_sqrt_pd(0xff, d2), k)));
+            v = _mm512_mask_blend_pd(_mm512_cmp_pd_mask(d2, r2, _CMP_LT_OQ), outside, v);
+        } else {
+            v = _mm512_mask_blend_pd(_mm512_cmp_pd_mask(d2, r2, _CMP_LE_OQ), outside, a);
+        }
+        _mm512_mask_storeu_pd(out+i, live, v);
+    }
+}
+#endif
+
+void falloff_n(const Falloff &f, const double *x, const double *y, const double *z, int n, double *out) {
+    int i = 0;
+    if (f.kind == FALLOFF_CONSTANT) {
+        for (; i < n; i++) out[i] = 0;
+        return;
+    }
+#ifdef SIMD_DISPATCH
+    if (simdLevel == SIMD_AVX512) return falloff_n_avx512(f, x, y, z, n, out);
+    if (simdLevel == SIMD_AVX2) return falloff_n_avx2(f, x, y, z, n, out);
+#endif
+#ifdef FALLOFF_SSE2
+    if (simdLevel >= SIMD_SSE2) {
+        const __m128d x0 = _mm_set1_pd(f.x0), y0 = _mm_set1_pd(f.y0), z0 = _mm_set1_pd(f.z0);
+        const __m128d r2 = _mm_set1_pd(f.radius2), k = _mm_set1_pd(f.k);
+        const __m128d a = _mm_set1_pd(f.a), b = _mm_set1_pd(f.b), outside = _mm_set1_pd(f.outside);
+        for (; i + 2 <= n; i += 2) {
+            __m128d dx = _mm_sub_pd(_mm_loadu_pd(x+i), x0);
+            __m128d dy = _mm_sub_pd(_mm_loadu_pd(y+i), y0);
+            __m128d dz = _mm_sub_pd(_mm_loadu_pd(z+i), z0);
+            __m128d d2 = _mm_add_pd(_mm_add_pd(_mm_mul_pd(dx, dx), _mm_mul_pd(dy, dy)), _mm_mul_pd(dz, dz));
+            __m128d v;
+            if (f.kind == FALLOFF_GAUSSIAN) {
+                v = _mm_add_pd(a, _mm_mul_pd(b, falloff_exp_pd(_mm_mul_pd(_mm_sub_pd(_mm_setzero_pd(), d2), k))));
+            } else if (f.kind == FALLOFF_TRIANGULAR) {
+                v = _mm_add_pd(a, _mm_mul_pd(b, _mm_div_pd(_mm_sqrt_pd(d2), k)));
+                v = falloff_select_pd(_mm_cmplt_pd(d2, r2), v, outside);
+            } else {
+                v = falloff_select_pd(_mm_cmple_pd(d2, r2), a, outside);
+            }
+            _mm_storeu_pd(out+i, v);
+        }
+    }
+#endif
+    for (; i < n; i++) out[i] = falloff_at(f, x[i], y[i], z[i]);
+}
+
+// Same test as inRegion for one point: inside or on the sphere
+inline bool sphere_inside(double x, double y, double z, double x0, double y0, double z0, double radius) {
+    double dx = x - x0, dy = y - y0, dz = z - z0;
+    return dx*dx + dy*dy + dz*dz <= radius*radius;
+}
+
+// out[i] = 1 if point i is inside the sphere, else 0
+void sphere_inside_n(const double *x, const double *y, const double *z, int n,
+double x0, double y0, double z0, double radius, unsigned char *out) {
+    int i = 0;
+#ifdef FALLOFF_SSE2
+    const __m128d cx = _mm_set1_pd(x0), cy = _mm_set1_pd(y0), cz = _mm_set1_pd(z0);
+    const __m128d r2 = _mm_set1_pd(radius*radius);
+    if (simdLevel >= SIMD_SSE2) for (; i + 2 <= n; i += 2) {
+        __m128d dx = _mm_sub_pd(_mm_loadu_pd(x+i), cx);
+        __m128d dy = _mm_sub_pd(_mm_loadu_pd(y+i), cy);
+        __m128d dz = _mm_sub_pd(_mm_loadu_pd(z+i), cz);
+        __m128d d2 = _mm_add_pd(_mm_add_pd(_mm_mul_pd(dx, dx), _mm_mul_pd(dy, dy)), _mm_mul_pd(dz, dz));
+        int m = _mm_movemask_pd(_mm_cmple_pd(d2, r2));
+        out[i] = m & 1;
+        out[i+1] = (m >> 1) & 1;
+    }
+#endif
+    for (; i < n; i++) out[i] = sphere_inside(x[i], y[i], z[i], x0, y0, z0, radius);
+}
+
 /*
 double constantFunc(const vec3f &p=vertices[t.v[0]].p, const vec3f &p0=vertices[t.v[0]].p, double radius=0, double scale=0) {
     return 0;
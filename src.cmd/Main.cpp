@@ -5,6 +5,7 @@
 // https://github.com/sp4cerat/Fast-Quadric-Mesh-Simplification
 //To compile for Linux/OSX (GCC/LLVM)
 //  g++ Main.cpp -O3 -o simplify
+//  add -fopenmp to run the per-vertex pre-passes in parallel
 //To compile for Windows (Visual Studio)
 // vcvarsall amd64
 // cl /EHsc Main.cpp /osimplify
@@ -15,10 +16,45 @@
 // https://github.com/neurolabusc/Fast-Quadric-Mesh-Simplification-Pascal-
 //
 
+#include "Simplify.h"
+// the same engine again with float positions, and with float throughout (-P)
+#define SIMPLIFY_NAMESPACE SimplifyMixed
+#define SIMPLIFY_POSITION float
+#include "Simplify.h"
+#define SIMPLIFY_NAMESPACE SimplifyFloat
+#define SIMPLIFY_POSITION float
+#define SIMPLIFY_QUADRIC float
+#include "Simplify.h"
+// and without quadrics (-m), with double or float positions
+#define SIMPLIFY_NAMESPACE SimplifyMemoryless
+#define SIMPLIFY_MEMORYLESS
+#include "Simplify.h"
+#define SIMPLIFY_NAMESPACE SimplifyMemorylessFloat
+#define SIMPLIFY_POSITION float
+#define SIMPLIFY_MEMORYLESS
 #include "Simplify.h"
 #include <stdio.h>
 #include <time.h>  // clock_t, clock, CLOCKS_PER_SEC
 #include <unistd.h>
+#include <signal.h>
+
+#ifdef COUNT_ALLOCS
+// g++ -DCOUNT_ALLOCS Main.cpp ...: count heap allocations, printed on exit
+#include <new>
+static size_t allocCount = 0, allocBytes = 0;
+void *operator new(size_t n) {
+    allocCount++;
+    allocBytes += n;
+    void *p = malloc(n ? n : 1);
+    if (!p) throw std::bad_alloc();
+    return p;
+}
+void operator delete(void *p) noexcept { free(p); }
+void operator delete(void *p, size_t) noexcept { free(p); }
+static struct AllocReport {
+    ~AllocReport() { printf("Allocations: %zu (%zu bytes)\n", allocCount, allocBytes); }
+} allocReport;
+#endif
 
 void showHelp(char *const argv[]) {
     const char *cstr = (argv[0]);
@@ -42,8 +78,44 @@ void showHelp(char *const argv[]) {
     printf("  -t <arg>  Total ratio of target's polygon count to source's (default: 0.5)\n");
     printf("  -T <arg1>,<arg2>  Region INSIDE radius will be reduced by ratio arg1. Region\n");
     printf("            OUTSIDE radius by arg2. -t option will be ignored.\n");
+    printf("            With arg2 = 1 only the region is simplified, outside is left as is.\n");
     printf("            Example: 0.8,0.1   \"( 0.1, 0.01 )\" (default: 0.5,0.5)\n");
     printf("  -a <arg>  Aggressiveness; higher=faster lower=better decimation (default: 7.0)\n");
+    printf("  -A <arg>  Adaptive thresholds: each pass removes about this fraction of the\n");
+    printf("            triangles still above the target, e.g. 0.5, whatever the units of\n");
+    printf("            the model. Replaces the schedule set by -a.\n");
+    printf("  -F <arg>  Finish exactly: passes stop within arg times the target of it, e.g.\n");
+    printf("            0.05, then the cheapest edges are collapsed one by one from a heap\n");
+    printf("            until the target is met. Uniform (-t) and -f reduction only.\n");
+    printf("  -B <arg>  Boundary quadrics of weight arg, e.g. 1000: open edges keep their\n");
+    printf("            place through the quadrics, so the border simplifies too.\n");
+    printf("  -H        Back the vertex, triangle and reference arrays with huge pages (Linux).\n");
+    printf("  -M        Reorder vertices along a Morton curve and triangles to match after\n");
+    printf("            loading, for better memory locality. Output order changes.\n");
+    printf("  -P <arg>  Precision of positions and quadrics; mixed and float use less memory\n");
+    printf("                ARG: double|mixed|float (default: double)\n");
+    printf("                mixed: float positions, double quadrics\n");
+    printf("  -I <arg>  Instruction set of the vector kernels, to compare them: the -f\n");
+    printf("            and -L factors, -L membership and the flip test. Quadric costs,\n");
+    printf("            file parsing and vertex welding are scalar and do not change.\n");
+    printf("                ARG: scalar|sse2|avx2|avx512 (default: best the CPU supports)\n");
+    printf("  -D <arg>  Deadline in milliseconds of wall-clock time from the start. When\n");
+    printf("            it passes, simplification stops and the mesh so far is written.\n");
+    printf("            SIGTERM does the same at any time.\n");
+    printf("  -C <arg>  Cluster vertices on a grid first, to about arg times the target's\n");
+    printf("            vertex count, then simplify the rest of the way. Much faster for\n");
+    printf("            large reductions; e.g. -C 4. Uniform reduction (-t) only.\n");
+    printf("  -R <arg>  Rebuild planar regions first: triangles within arg times the bounding\n");
+    printf("            box diagonal of a common plane, e.g. 1e-6, are retriangulated from\n");
+    printf("            the corners of their outline. For CAD models.\n");
+    printf("  -e <arg>  Error bound as a fraction of the bounding box diagonal, e.g. 0.001.\n");
+    printf("            No collapse may cost more than (arg*diagonal)^2, and simplification\n");
+    printf("            stops when none is left below it. Without -t there is no count target.\n");
+    printf("  -l        Lossless: remove only the edges that cost nothing, as in flat areas,\n");
+    printf("            with no count target. -e arg sets the tolerance (default: 1e-6).\n");
+    printf("  -m        Memoryless: no quadric per vertex, collapse costs from the current\n");
+    printf("            volume and boundary around each edge (Lindstrom-Turk). With -P\n");
+    printf("            mixed or float the positions are float.\n");
     printf(" Function options for a spacially non-uniform reduction:\n");
     printf("  -f <arg>  Function name\n");
     printf("                ARG: square|triangular|gaussian (default: constFunc)\n");
@@ -64,19 +136,21 @@ void showHelp(char *const argv[]) {
     printf("  -n        Negative form of function used.\n");
     printf("  -b <arg>  Breaking all iterations if selected number of consecutive iterations\n");
     printf("            failed to delete triangles. (default: 1000)\n");
+    printf("  -L <arg>  Text file of regions, one per line, each with its own target ratio\n");
+    printf("            and function: -q|-Q <ratio> -f <func> -c <x,y,z> -r <r> -s <s> -p <p> -n true|false\n");
+    printf("            -Q bounds the function to its radius. Stops once every region is done.\n");
 } //showHelp()
 
 // int getopt(int argc, char *const argv[], const char *optstring);
 // extern char *optarg;
 // extern int optind, opterr, optopt;
 
-int main(int argc, char *const argv[]) {
-    printf("Mesh Simplification (C)2014 by Sven Forstmann in 2014, MIT License (%zu-bit)\n", sizeof(size_t)*8);
-    
+// Command line options, applied to whichever engine -P selects
+struct Options {
     double reduceFraction = 0.5;
     double aggressiveness = 7.0;
     double (*func)(double, double, double, double, double, double, double, double, bool) = constantFunc;
-    double coord[] = {0, 0, 0};
+    double coord[3] = {0, 0, 0};
     double radius = 1.0;
     double scale = 1.0;
     double power = 3.0;
@@ -84,76 +158,251 @@ int main(int argc, char *const argv[]) {
     bool Toption = false;
     char filetxt[512];
     bool doRegionSimplification = false;
+    bool doRegionOnly = false;
     bool isVerbose = false, isNegative = false;
-    int tempverboselines, verboselines = 1000000;
+    bool doReorder = false;
+    int verboselines = 1000000;
+    double targetRegionRatio = 0, targetOutsideRatio = 0;
+    int consecutiveNoDeletionThreshold = Simplify::consecutiveNoDeletionThreshold;
+    bool hugePages = false;
+    const char *precision = "double";
+    bool simdForced = false;
+    bool memoryless = false;
+    double clusterFactor = 0;
+    double planarTolerance = 0;
+    double deadlineMs = 0;
+    double maxError = 0;
+    double adaptiveFraction = 0;
+    double heapMargin = 0;
+    double borderWeight = 0;
+    bool lossless = false;
+    bool hasRatio = false;
+};
+
+// SIGTERM: finish the current collapse, then write what there is
+void requestStop(int) { simplifyStopRequested = 1; }
+
+template<class E> int run(const char *fileIn, const char *fileOut, Options o) {
+    if (o.deadlineMs > 0) E::set_deadline_ms(o.deadlineMs);
+    E::target_region_ratio = o.targetRegionRatio;
+    E::target_outside_ratio = o.targetOutsideRatio;
+    E::consecutiveNoDeletionThreshold = o.consecutiveNoDeletionThreshold;
+    E::hugePages = o.hugePages;
+    E::maxError = o.maxError;
+    E::adaptiveFraction = o.adaptiveFraction;
+    E::heapMargin = o.heapMargin;
+    E::borderWeight = o.borderWeight;
+    if (o.lossless && (o.maxError > 0)) E::losslessTolerance = o.maxError;
+    clock_t load_start = clock();
+    std::string filenameIn(fileIn);
+    std::string filenameOut(fileOut);
+    std::string::size_type idx;
+    std::string::size_type outidx;
+    idx = filenameIn.rfind('.');
+    outidx = filenameOut.rfind('.');
+    bool doloadobj = false, doloadtri10 = false, dowriteobj = false, dowritetri10 = false, dowritetri9 = false;
+    if (idx != std::string::npos) {
+        std::string extensionIn = filenameIn.substr(idx+1);
+        if (extensionIn == "obj") doloadobj = true;
+        else if (extensionIn == "tri10") doloadtri10 = true;
+        else if (extensionIn == "tri9") doloadtri10 = true; // load_tri10 will read tri9 the same
+        else {
+            printf("Cannot load file with extension .%s\n", extensionIn.c_str());
+            return EXIT_FAILURE;
+        }
+    } else {
+        printf("Input file's extension not found.\n");
+        return EXIT_FAILURE;
+    }
+    if (outidx != std::string::npos) {
+        std::string extensionOut = filenameOut.substr(outidx+1);
+        if (extensionOut == "obj") dowriteobj = true;
+        else if (extensionOut == "tri10") dowritetri10 = true;
+        else if (extensionOut == "tri9") dowritetri9 = true;
+        else {
+            printf("Cannot write to file with extension .%s\n", extensionOut.c_str());
+            return EXIT_FAILURE;
+        }
+    } else {
+        printf("Output file's extension not found.\n");
+        return EXIT_FAILURE;
+    }
+    if (doloadobj) E::load_obj(fileIn, o.isVerbose, o.verboselines);
+    else if (doloadtri10) E::load_tri10(fileIn, o.isVerbose, o.verboselines);
+    if (o.doReorder) E::reorder_mesh();
+    if (o.Toption) {
+        if (E::target_outside_ratio == -1) o.reduceFraction = E::target_region_ratio; // Use -T <arg1> for outside ratio
+        else o.reduceFraction = E::target_outside_ratio;
+        o.doRegionSimplification = false;
+        // Outside kept as is: simplify the region's submesh alone
+        o.doRegionOnly = (E::target_outside_ratio == 1) && !o.doloadtxt;
+    }
+    if (o.doloadtxt) {
+        if (E::load_txt(o.filetxt, o.isVerbose) != EXIT_SUCCESS) return EXIT_FAILURE;
+        if (E::regions.empty()) {
+            printf("Error: No regions read from %s\n", o.filetxt);
+            return EXIT_FAILURE;
+        }
+        double minRegionRatio = 1;
+        for (int i = 0; i < int(E::regions.size()); i++) {
+            minRegionRatio = min(minRegionRatio, E::regions[i].regionTarget);
+        }
+        o.reduceFraction = min(o.reduceFraction, minRegionRatio);
+    }
+    printf("File(s) loaded in %.4f sec\n", ((float)(clock()-load_start))/CLOCKS_PER_SEC);
+	if ((E::triangles.size() < 3) || (E::vertices.size() < 3))
+		return EXIT_FAILURE;
+	int target_count = round((float)E::triangles.size() * o.reduceFraction);
+    bool errorOnly = (o.maxError > 0) && !o.hasRatio && !o.Toption && !o.doloadtxt && !o.lossless;
+    if (errorOnly || o.lossless) target_count = 0; // only the error bound stops it
+    else if (target_count < 4) {
+		printf("Object will not survive such extreme decimation\n");
+    	return EXIT_FAILURE;
+    }
+	clock_t start = clock();
+	if (o.isVerbose) printf("Precision: %s (%zu bytes per vertex, %zu per triangle)\n", E::name(), E::vertex_bytes(), E::triangle_bytes());
+	printf("SIMD: %s (%s)\n", simdNames[simdLevel], o.simdForced ? "forced with -I" : "best supported");
+	printf("Input: %zu vertices, %zu triangles", E::vertices.size(), E::triangles.size());
+    if (o.lossless) printf(" (lossless, tolerance %g of diagonal)\n", E::losslessTolerance);
+    else if (errorOnly) printf(" (error bound %g of diagonal)\n", o.maxError);
+    else if(!(o.doRegionSimplification || o.doloadtxt || o.doRegionOnly)) printf(" (target %d)\n", target_count); else printf("\n");
+	int startSize = int(E::triangles.size());
+    E::initialTotalCount = startSize;
+    if (o.doRegionSimplification) {
+        E::initialRegionCount = 0;
+        for (int i = 0; i < (int)(E::triangles.size()); i++) {
+            if (E::inRegion(E::triangles[i], o.coord, o.radius)) {
+                E::initialRegionCount++;
+            }
+        }
+    }
+    double planarTime = 0;
+    if (o.planarTolerance > 0) {
+        if (o.Toption || o.doloadtxt) printf("Warning: -R is ignored with -T and -L\n");
+        else {
+            clock_t planar_start = clock();
+            int rebuilt = E::retriangulate_planar(o.planarTolerance, o.isVerbose);
+            planarTime = ((float)(clock()-planar_start))/CLOCKS_PER_SEC;
+            printf("Planar regions: %d rebuilt, %zu vertices, %zu triangles (%.4f sec)\n", rebuilt, E::vertices.size(), E::triangles.size(), planarTime);
+        }
+    }
+    double clusterTime = 0;
+    if (o.clusterFactor > 0) {
+        if (errorOnly || o.lossless) printf("Warning: -C needs a target ratio (-t), ignored\n");
+        else if (o.Toption || o.doloadtxt || (o.func != constantFunc)) printf("Warning: -C is for uniform reduction, ignored with -T, -L and -f\n");
+        else {
+            clock_t cluster_start = clock();
+            E::cluster_mesh(int(o.clusterFactor * target_count / 2), o.isVerbose);
+            clusterTime = ((float)(clock()-cluster_start))/CLOCKS_PER_SEC;
+            printf("Clustered: %zu vertices, %zu triangles (%.4f sec)\n", E::vertices.size(), E::triangles.size(), clusterTime);
+        }
+    }
+    if (o.lossless) E::simplify_mesh_lossless(o.isVerbose);
+    else if (o.doRegionOnly) E::simplify_region_only(o.coord, E::target_region_ratio, o.aggressiveness, o.isVerbose, o.func, o.radius, o.scale, o.power, o.isNegative);
+    else E::simplify_mesh(o.coord, target_count, o.aggressiveness, o.isVerbose, o.func, o.radius, o.scale, o.power, o.isNegative, o.doRegionSimplification, o.doloadtxt);
+    if (E::stoppedEarly) printf("Stopped early (%s): target not reached, writing %zu triangles\n", simplifyStopRequested ? "SIGTERM" : "deadline", E::triangles.size());
+	if ((int(E::triangles.size()) >= startSize) && !E::stoppedEarly) {
+		printf("Unable to reduce mesh. Output number of triangles would be >= input number of triangles.\n");
+    	return EXIT_FAILURE;
+	}
+	if (dowriteobj) E::write_obj(fileOut, o.isVerbose, o.verboselines);
+    else if (dowritetri10) E::write_tri10(fileOut, o.isVerbose, o.verboselines);
+    else if (dowritetri9) E::write_tri9(fileOut, o.isVerbose, o.verboselines);
+    if ((o.doRegionSimplification || o.doRegionOnly) && E::regionDone) printf("Inside Region Reduction:  %.8lf (%d triangles)\nOutside Region Reduction: %.8lf (%d triangles)\n",
+				 E::currentRegionRatio, E::currentRegionCount, E::currentOutsideRatio, (int)(E::triangles.size()) - E::currentRegionCount);
+    if (o.doloadtxt) {
+        for (int i = 0; i < int(E::regions.size()); i++) {
+            const typename E::Region &r = E::regions[i];
+            printf("Region %d Reduction: %.8lf (%d triangles)\n", i+1, r.startCount ? double(r.endCount)/r.startCount : 1.0, r.endCount);
+        }
+    }
+    if ((o.maxError > 0) || o.isVerbose) {
+        double diagonal = E::bounding_diagonal();
+        double meanError = E::collapseCount ? E::collapseErrorSum / E::collapseCount : 0;
+        printf("Collapse error: max %g, mean %g over %d collapses (max %.6g of diagonal)\n", E::collapseErrorMax, meanError, E::collapseCount,
+            diagonal > 0 ? sqrt(E::collapseErrorMax) / diagonal : 0.0);
+    }
+	printf("Output: %zu vertices, %zu triangles (%.6f%% overall reduction; %.4f sec)\n",E::vertices.size(), E::triangles.size()
+		, (float)E::triangles.size()/ (float) startSize *100.0 , ((float)(clock()-start))/CLOCKS_PER_SEC );
+    if (o.clusterFactor > 0 && clusterTime > 0) printf("Time: clustering %.4f sec, quadric simplification %.4f sec\n", clusterTime, ((float)(clock()-start))/CLOCKS_PER_SEC - clusterTime - planarTime);
+    if (planarTime > 0) printf("Time: planar regions %.4f sec, simplification %.4f sec\n", planarTime, ((float)(clock()-start))/CLOCKS_PER_SEC - planarTime - clusterTime);
+	return EXIT_SUCCESS;
+}
+
+int main(int argc, char *const argv[]) {
+    printf("Mesh Simplification (C)2014 by Sven Forstmann in 2014, MIT License (%zu-bit)\n", sizeof(size_t)*8);
+    signal(SIGTERM, requestStop);
+    
+    Options o;
+    int tempverboselines;
     int tempConsecutiveNoDeletionThreshold;
 
     int c;
     char *poutside;
 	char *pcoord;
-    const char *optstring = "t:a:f:c:r:s:p:T:L:V:b:vnh";
+    const char *optstring = "t:a:f:c:r:s:p:T:L:V:b:P:C:D:e:A:F:B:R:I:vnhHMml";
     while ((c = getopt(argc, argv, optstring)) != -1) {
         switch (c) {
         case 't':
             {
             char *endptr;
             double d = strtod(optarg, &endptr);
-            if(*endptr == '\0') reduceFraction = d;
+            if(*endptr == '\0') { o.reduceFraction = d; o.hasRatio = true; }
             else {
                 printf("Error: Could not read -t argument (needs a number).\n");
                 return EXIT_FAILURE;
             }
             }
-            if ((reduceFraction <= 0.0) || (reduceFraction > 1.0)) {
+            if ((o.reduceFraction <= 0.0) || (o.reduceFraction > 1.0)) {
                 printf("Error: Ratio must be BETWEEN zero and one.\n");
                 return EXIT_FAILURE;
             }
             break;
         case 'T':
-            Toption = true;
+            o.Toption = true;
             {
             char *pstart = strtok(optarg, "{[( ,)]}");
             char *endptr;
             double d = strtod(pstart, &endptr);
-            if(*endptr == '\0') Simplify::target_region_ratio = d;
+            if(*endptr == '\0') o.targetRegionRatio = d;
             else {
                 printf("Error: Could not read -T argument1 (needs a number).\n");
                 return EXIT_FAILURE;
             }
-            if (Simplify::target_region_ratio > 1) {
+            if (o.targetRegionRatio > 1) {
                 printf("Error: Cannot use Region's ratio greater than 1.\n");
                 return EXIT_FAILURE;
             }
-            Simplify::target_outside_ratio = -1;
+            o.targetOutsideRatio = -1;
             poutside = strtok(NULL, "{[( ,)]}");
             if (poutside != NULL) {
-                Simplify::target_outside_ratio = atof(poutside);
+                o.targetOutsideRatio = atof(poutside);
                 {
                 d = strtod(poutside, &endptr);
-                if(*endptr == '\0') Simplify::target_outside_ratio = d;
+                if(*endptr == '\0') o.targetOutsideRatio = d;
                 else {
                     printf("Error: Could not read -T argument2 (needs a number).\n");
                     return EXIT_FAILURE;
                 }
                 }
-                if (Simplify::target_outside_ratio > 1) {
+                if (o.targetOutsideRatio > 1) {
                     printf("Error: Cannot use Region's ratio greater than 1.\n");
                     return EXIT_FAILURE;
                 }
             }
             }
-            reduceFraction = min(double(Simplify::target_region_ratio), double(Simplify::target_outside_ratio));
-            doRegionSimplification = true;
+            o.reduceFraction = min(double(o.targetRegionRatio), double(o.targetOutsideRatio));
+            o.doRegionSimplification = true;
             break;
         case 'L':
-            strcpy(filetxt, optarg);
-            //doloadtxt = true;
+            strcpy(o.filetxt, optarg);
+            o.doloadtxt = true;
             break;
         case 'a':
             {
             char *endptr;
             double d = strtod(optarg, &endptr);
-            if(*endptr == '\0') aggressiveness = d;
+            if(*endptr == '\0') o.aggressiveness = d;
             else {
                 printf("Error: Could not read -a argument (needs a number).\n");
                 return EXIT_FAILURE;
@@ -164,13 +413,13 @@ int main(int argc, char *const argv[]) {
             printf("Checking function: ");
             if (strcmp(optarg, "gaussian") == 0) {
                 printf("gaussian\n");
-                func = gaussian;
+                o.func = gaussian;
             } else if (strcmp(optarg, "triangular") == 0) {
                 printf("triangular\n");
-                func = triangular;
+                o.func = triangular;
             } else if (strcmp(optarg, "square") == 0) {
                 printf("square\n");
-                func = square;
+                o.func = square;
             } else {
                 printf("WARNING: Could not read function identifier, using constant function (uniform)\n");
             }
@@ -181,7 +430,7 @@ int main(int argc, char *const argv[]) {
                 {
                 char *endptr;
                 double d = strtod(pcoord, &endptr);
-                if(*endptr == '\0') coord[i] = d;
+                if(*endptr == '\0') o.coord[i] = d;
                 else {
                     printf("Error: Could not read -c arguments (needs a number).\n");
                     return EXIT_FAILURE;
@@ -194,7 +443,7 @@ int main(int argc, char *const argv[]) {
             {
             char *endptr;
             double d = strtod(optarg, &endptr);
-            if(*endptr == '\0') radius = d;
+            if(*endptr == '\0') o.radius = d;
             else {
                 printf("Error: Could not read -r argument (needs a number).\n");
                 return EXIT_FAILURE;
@@ -204,7 +453,7 @@ int main(int argc, char *const argv[]) {
             {
             char *endptr;
             double d = strtod(optarg, &endptr);
-            if(*endptr == '\0') scale = d;
+            if(*endptr == '\0') o.scale = d;
             else {
                 printf("Error: Could not read -s argument (needs a number).\n");
                 return EXIT_FAILURE;
@@ -215,7 +464,7 @@ int main(int argc, char *const argv[]) {
             {
             char *endptr;
             double d = strtod(optarg, &endptr);
-            if(*endptr == '\0') power = d;
+            if(*endptr == '\0') o.power = d;
             else {
                 printf("Error: Could not read -p argument (needs a number).\n");
                 return EXIT_FAILURE;
@@ -223,24 +472,24 @@ int main(int argc, char *const argv[]) {
             }
             break;
         case 'v':
-            isVerbose = true;
+            o.isVerbose = true;
             break;
         case 'V':
-            isVerbose = true;
+            o.isVerbose = true;
             {
             char *endptr;
             double d = strtod(optarg, &endptr);
             if(*endptr == '\0') tempverboselines = int(d);
             else {
-                printf("Error: Could not read -V argument (needs a number). Using default: %d.\n", verboselines);
-                tempverboselines = verboselines;
+                printf("Error: Could not read -V argument (needs a number). Using default: %d.\n", o.verboselines);
+                tempverboselines = o.verboselines;
             }
             }
             if (tempverboselines <= 0) {
-                printf("-V needs an valid argument greater than 0, using default: %d\n", verboselines);
-                tempverboselines = verboselines;
+                printf("-V needs an valid argument greater than 0, using default: %d\n", o.verboselines);
+                tempverboselines = o.verboselines;
             }
-            verboselines = tempverboselines;
+            o.verboselines = tempverboselines;
             break;
         case 'b':
             {
@@ -248,18 +497,131 @@ int main(int argc, char *const argv[]) {
             double d = strtod(optarg, &endptr);
             if(*endptr == '\0') tempConsecutiveNoDeletionThreshold = int(d);
             else {
-                printf("Error: Could not read -b argument (needs a number), using default: %d\n", Simplify::consecutiveNoDeletionThreshold);
-                tempConsecutiveNoDeletionThreshold = Simplify::consecutiveNoDeletionThreshold;
+                printf("Error: Could not read -b argument (needs a number), using default: %d\n", o.consecutiveNoDeletionThreshold);
+                tempConsecutiveNoDeletionThreshold = o.consecutiveNoDeletionThreshold;
             }
             }
             if (tempConsecutiveNoDeletionThreshold <= 0) {
-                printf("-b needs a positive integer, using default: %d\n", Simplify::consecutiveNoDeletionThreshold);
-                tempConsecutiveNoDeletionThreshold = Simplify::consecutiveNoDeletionThreshold;
+                printf("-b needs a positive integer, using default: %d\n", o.consecutiveNoDeletionThreshold);
+                tempConsecutiveNoDeletionThreshold = o.consecutiveNoDeletionThreshold;
             }
-            Simplify::consecutiveNoDeletionThreshold = tempConsecutiveNoDeletionThreshold;
+            o.consecutiveNoDeletionThreshold = tempConsecutiveNoDeletionThreshold;
             break;
         case 'n':
-            isNegative = true;
+            o.isNegative = true;
+            break;
+        case 'H':
+            o.hugePages = true;
+            break;
+        case 'M':
+            o.doReorder = true;
+            break;
+        case 'm':
+            o.memoryless = true;
+            break;
+        case 'l':
+            o.lossless = true;
+            break;
+        case 'A':
+            {
+            char *endptr;
+            double d = strtod(optarg, &endptr);
+            if((*endptr == '\0') && (d > 0) && (d <= 1)) o.adaptiveFraction = d;
+            else {
+                printf("Error: -A needs a fraction above zero and at most one.\n");
+                return EXIT_FAILURE;
+            }
+            }
+            break;
+        case 'B':
+            {
+            char *endptr;
+            double d = strtod(optarg, &endptr);
+            if((*endptr == '\0') && (d > 0)) o.borderWeight = d;
+            else {
+                printf("Error: -B needs a positive weight.\n");
+                return EXIT_FAILURE;
+            }
+            }
+            break;
+        case 'F':
+            {
+            char *endptr;
+            double d = strtod(optarg, &endptr);
+            if((*endptr == '\0') && (d > 0)) o.heapMargin = d;
+            else {
+                printf("Error: -F needs a positive margin, as a fraction of the target.\n");
+                return EXIT_FAILURE;
+            }
+            }
+            break;
+        case 'e':
+            {
+            char *endptr;
+            double d = strtod(optarg, &endptr);
+            if((*endptr == '\0') && (d > 0)) o.maxError = d;
+            else {
+                printf("Error: -e needs a positive fraction of the bounding box diagonal.\n");
+                return EXIT_FAILURE;
+            }
+            }
+            break;
+        case 'D':
+            {
+            char *endptr;
+            double d = strtod(optarg, &endptr);
+            if((*endptr == '\0') && (d > 0)) o.deadlineMs = d;
+            else {
+                printf("Error: -D needs a positive number of milliseconds.\n");
+                return EXIT_FAILURE;
+            }
+            }
+            break;
+        case 'R':
+            {
+            char *endptr;
+            double d = strtod(optarg, &endptr);
+            if((*endptr == '\0') && (d > 0)) o.planarTolerance = d;
+            else {
+                printf("Error: -R needs a positive fraction of the bounding box diagonal.\n");
+                return EXIT_FAILURE;
+            }
+            }
+            break;
+        case 'C':
+            {
+            char *endptr;
+            double d = strtod(optarg, &endptr);
+            if((*endptr == '\0') && (d >= 1)) o.clusterFactor = d;
+            else {
+                printf("Error: -C needs a number of at least 1.\n");
+                return EXIT_FAILURE;
+            }
+            }
+            break;
+        case 'P':
+            if ((strcmp(optarg, "double") != 0) && (strcmp(optarg, "mixed") != 0) && (strcmp(optarg, "float") != 0)) {
+                printf("Error: -P needs double, mixed or float.\n");
+                return EXIT_FAILURE;
+            }
+            o.precision = optarg;
+            break;
+        case 'I':
+            {
+            int level = -1;
+            for (int i = SIMD_SCALAR; i <= SIMD_AVX512; i++) if (strcmp(optarg, simdNames[i]) == 0) level = i;
+            if (level < 0) {
+                printf("Error: -I needs scalar, sse2, avx2 or avx512.\n");
+                return EXIT_FAILURE;
+            }
+            SimdLevel best = simd_detect();
+            if (level > best) {
+                printf("Error: -I %s is not supported here (at most %s).\n", optarg, simdNames[best]);
+                return EXIT_FAILURE;
+            }
+            o.simdForced = level != best;
+            simdLevel = SimdLevel(level);
+            }
             break;
         case '?':
         case 'h':
@@ -269,8 +631,8 @@ int main(int argc, char *const argv[]) {
             return EXIT_FAILURE;
         }
     }
-    if ((func == gaussian) && (scale <= 1)) {
-		printf("  Warning: detected -s %g for gaussian. scale must be > 1. Will use default = 2\n", scale);
+    if ((o.func == gaussian) && (o.scale <= 1)) {
+		printf("  Warning: detected -s %g for gaussian. scale must be > 1. Will use default = 2\n", o.scale);
         printf("      Gaussian ~ exp( -1 / ((radius^2)/log(scale)) ), Cannot use log( scale <= 1 )\n");
         printf("      Gaussian amplitude is 1/scale at radius\n");
     }
@@ -278,88 +640,19 @@ int main(int argc, char *const argv[]) {
         showHelp(argv);
         return EXIT_SUCCESS;
     }
-    clock_t load_start = clock();
-    std::string filenameIn(argv[optind]);
-    std::string filenameOut(argv[optind+1]);
-    std::string::size_type idx;
-    std::string::size_type outidx;
-    idx = filenameIn.rfind('.');
-    outidx = filenameOut.rfind('.');
-    bool doloadobj = false, doloadtri10 = false, dowriteobj = false, dowritetri10 = false, dowritetri9 = false;
-    if (idx != std::string::npos) {
-        std::string extensionIn = filenameIn.substr(idx+1);
-        if (extensionIn == "obj") doloadobj = true;
-        else if (extensionIn == "tri10") doloadtri10 = true;
-        else if (extensionIn == "tri9") doloadtri10 = true; // load_tri10 will read tri9 the same
-        else {
-            printf("Cannot load file with extension .%s\n", extensionIn.c_str());
-            return EXIT_FAILURE;
-        }
-    } else {
-        printf("Input file's extension not found.\n");
-        return EXIT_FAILURE;
+    if (o.lossless && (o.hasRatio || o.Toption || o.doloadtxt)) {
+        printf("Warning: -l has no count target, -t, -T and -L are ignored\n");
+        o.Toption = o.doloadtxt = false;
     }
-    if (outidx != std::string::npos) {
-        std::string extensionOut = filenameOut.substr(outidx+1);
-        if (extensionOut == "obj") dowriteobj = true;
-        else if (extensionOut == "tri10") dowritetri10 = true;
-        else if (extensionOut == "tri9") dowritetri9 = true;
-        else {
-            printf("Cannot write to file with extension .%s\n", extensionOut.c_str());
-            return EXIT_FAILURE;
-        }
-    } else {
-        printf("Output file's extension not found.\n");
-        return EXIT_FAILURE;
-    }
-    if (doloadobj) Simplify::load_obj(argv[optind], isVerbose, verboselines);
-    else if (doloadtri10) Simplify::load_tri10(argv[optind], isVerbose, verboselines);
-    if (Toption) {
-        if (Simplify::target_outside_ratio == -1) reduceFraction = Simplify::target_region_ratio; // Use -T <arg1> for outside ratio
-        else reduceFraction = Simplify::target_outside_ratio;
-        doRegionSimplification = false;
-    }
-    if (doloadtxt) {
-        Simplify::load_txt(filetxt, isVerbose);
-        double minRegionRatio = 0; 
-        for (int i = 0; i < int(Simplify::regions.size()) - 1; i++) {
-            minRegionRatio = min(Simplify::regions[i].regionTarget, Simplify::regions[i+1].regionTarget);
+    if (o.memoryless) {
+        if (o.borderWeight > 0) {
+            printf("Warning: -B is ignored with -m, whose costs keep the boundary already\n");
+            o.borderWeight = 0;
         }
-        reduceFraction = min(reduceFraction, minRegionRatio);
+        if (strcmp(o.precision, "double") == 0) return run<SimplifyMemoryless::Engine>(argv[optind], argv[optind+1], o);
+        return run<SimplifyMemorylessFloat::Engine>(argv[optind], argv[optind+1], o);
     }
-    printf("File(s) loaded in %.4f sec\n", ((float)(clock()-load_start))/CLOCKS_PER_SEC);
-	if ((Simplify::triangles.size() < 3) || (Simplify::vertices.size() < 3))
-		return EXIT_FAILURE;
-	int target_count = round((float)Simplify::triangles.size() * reduceFraction);
-    if (target_count < 4) {
-		printf("Object will not survive such extreme decimation\n");
-    	return EXIT_FAILURE;
-    }
-	clock_t start = clock();
-	printf("Input: %zu vertices, %zu triangles", Simplify::vertices.size(), Simplify::triangles.size());
-    if(!(doRegionSimplification || doloadtxt)) printf(" (target %d)\n", target_count); else printf("\n");
-	int startSize = int(Simplify::triangles.size());
-    Simplify::initialTotalCount = startSize;
-    if (doRegionSimplification) {
-        Simplify::initialRegionCount = 0;
-        for (int i = 0; i < (int)(Simplify::triangles.size()); i++) {
-            if (Simplify::inRegion(Simplify::triangles[i], coord, radius)) {
-                Simplify::initialRegionCount++;
-            }
-        }
-    }
-    Simplify::simplify_mesh(coord, target_count, aggressiveness, isVerbose, func, radius, scale, power, isNegative, doRegionSimplification, doloadtxt);
-	//Simplify::simplify_mesh_lossless( false);
-	if (int(Simplify::triangles.size()) >= startSize) {
-		printf("Unable to reduce mesh. Output number of triangles would be >= input number of triangles.\n");
-    	return EXIT_FAILURE;
-	}
-	if (dowriteobj) Simplify::write_obj(argv[optind+1], isVerbose, verboselines);
-    else if (dowritetri10) Simplify::write_tri10(argv[optind+1], isVerbose, verboselines);
-    else if (dowritetri9) Simplify::write_tri9(argv[optind+1], isVerbose, verboselines);
-    if (doRegionSimplification && Simplify::regionDone) printf("Inside Region Reduction:  %.8lf (%d triangles)\nOutside Region Reduction: %.8lf (%d triangles)\n",
-				 Simplify::currentRegionRatio, Simplify::currentRegionCount, Simplify::currentOutsideRatio, (int)(Simplify::triangles.size()) - Simplify::currentRegionCount);
-	printf("Output: %zu vertices, %zu triangles (%.6f%% overall reduction; %.4f sec)\n",Simplify::vertices.size(), Simplify::triangles.size()
-		, (float)Simplify::triangles.size()/ (float) startSize *100.0 , ((float)(clock()-start))/CLOCKS_PER_SEC );
-	return EXIT_SUCCESS;
+    if (strcmp(o.precision, "mixed") == 0) return run<SimplifyMixed::Engine>(argv[optind], argv[optind+1], o);
+    if (strcmp(o.precision, "float") == 0) return run<SimplifyFloat::Engine>(argv[optind], argv[optind+1], o);
+    return run<Simplify::Engine>(argv[optind], argv[optind+1], o);
 }
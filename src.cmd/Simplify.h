@@ -16,6 +16,9 @@
 //#include <functional>
 //#include <sys/stat.h>
 //#include <stdbool.h>
+#ifndef SIMPLIFY_COMMON_H
+#define SIMPLIFY_COMMON_H
+
 #include <string.h>
 //#include <ctype.h>
 //#include <float.h>
@@ -30,72 +33,88 @@
 #include <unordered_map>
 #include <unordered_set>
 #include <set>
+#include <limits>
+#include <chrono>
+#include <signal.h> // sig_atomic_t
 #include <cstdlib>
+#ifdef __linux__
+#include <sys/mman.h> // madvise
+#endif
 #include "Functions.h"
 
 // #define loopi(start_l,end_l) for ( int i=start_l;i<end_l;++i )
 #define loopi(start_l,end_l) for ( int i=start_l;i<int(end_l);++i )
 #define loopj(start_l,end_l) for ( int j=start_l;j<int(end_l);++j )
 #define loopk(start_l,end_l) for ( int k=start_l;k<end_l;++k )
+// OpenMP directives, only when built with -fopenmp; a plain build compiles
+// the loops serially without unknown-pragma warnings
+#ifdef _OPENMP
+#define OMP(directive) _Pragma(#directive)
+#else
+#define OMP(directive)
+#endif
 
 struct vector3
 {
 double x, y, z;
 };
 
-struct vec3f
+template<class T> struct vec3
 {
-    double x, y, z;
+    T x, y, z;
+
+    inline vec3( void ) {}
 
-    inline vec3f( void ) {}
+    template<class U> inline vec3( const vec3<U> &a )
+    { x = T(a.x); y = T(a.y); z = T(a.z); }
 
-    //inline vec3f operator =( vector3 a )
-	// { vec3f b ; b.x = a.x; b.y = a.y; b.z = a.z; return b;}
+    //inline vec3 operator =( vector3 a )
+	// { vec3 b ; b.x = a.x; b.y = a.y; b.z = a.z; return b;}
 
-    inline vec3f( vector3 a )
+    inline vec3( vector3 a )
 	 { x = a.x; y = a.y; z = a.z; }
 
-    inline vec3f( const double X, const double Y, const double Z )
+    inline vec3( const T X, const T Y, const T Z )
     { x = X; y = Y; z = Z; }
 
-    inline vec3f operator + ( const vec3f& a ) const
-    { return vec3f( x + a.x, y + a.y, z + a.z ); }
+    inline vec3 operator + ( const vec3& a ) const
+    { return vec3( x + a.x, y + a.y, z + a.z ); }
 
-	inline vec3f operator += ( const vec3f& a ) const
-    { return vec3f( x + a.x, y + a.y, z + a.z ); }
+	inline vec3 operator += ( const vec3& a ) const
+    { return vec3( x + a.x, y + a.y, z + a.z ); }
 
-    inline vec3f operator * ( const double a ) const
-    { return vec3f( x * a, y * a, z * a ); }
+    inline vec3 operator * ( const T a ) const
+    { return vec3( x * a, y * a, z * a ); }
 
-    inline vec3f operator * ( const vec3f a ) const
-    { return vec3f( x * a.x, y * a.y, z * a.z ); }
+    inline vec3 operator * ( const vec3 a ) const
+    { return vec3( x * a.x, y * a.y, z * a.z ); }
 
-    inline vec3f v3 () const
-    { return vec3f( x , y, z ); }
+    inline vec3 v3 () const
+    { return vec3( x , y, z ); }
 
-    inline vec3f operator = ( const vector3 a )
+    inline vec3 operator = ( const vector3 a )
     { x=a.x;y=a.y;z=a.z;return *this; }
 
-	inline bool operator==(const vec3f a) {
+	inline bool operator==(const vec3 a) {
         return ((x == a.x) && (y == a.y) && (z == a.z));
     }
 	
-    inline vec3f operator = ( const vec3f a )
+    inline vec3 operator = ( const vec3 a )
     { x=a.x;y=a.y;z=a.z;return *this; }
 
-    inline vec3f operator / ( const vec3f a ) const
-    { return vec3f( x / a.x, y / a.y, z / a.z ); }
+    inline vec3 operator / ( const vec3 a ) const
+    { return vec3( x / a.x, y / a.y, z / a.z ); }
 
-    inline vec3f operator - ( const vec3f& a ) const
-    { return vec3f( x - a.x, y - a.y, z - a.z ); }
+    inline vec3 operator - ( const vec3& a ) const
+    { return vec3( x - a.x, y - a.y, z - a.z ); }
 
-    inline vec3f operator / ( const double a ) const
-    { return vec3f( x / a, y / a, z / a ); }
+    inline vec3 operator / ( const T a ) const
+    { return vec3( x / a, y / a, z / a ); }
 
-    inline double dot( const vec3f& a ) const
+    inline T dot( const vec3& a ) const
     { return a.x*x + a.y*y + a.z*z; }
 
-    inline vec3f cross( const vec3f& a , const vec3f& b )
+    inline vec3 cross( const vec3& a , const vec3& b )
     {
 		x = a.y * b.z - a.z * b.y;
 		y = a.z * b.x - a.x * b.z;
@@ -103,9 +122,9 @@ struct vec3f
 		return *this;
 	}
 
-    inline double angle( const vec3f& v )
+    inline double angle( const vec3& v )
     {
-		vec3f a = v , b = *this;
+		vec3 a = v , b = *this;
 		double dot = v.x*x + v.y*y + v.z*z;
 		double len = a.length() * b.length();
 		if(len==0)len=0.00001f;
@@ -115,14 +134,14 @@ struct vec3f
 		return (double) acos ( input );
 	}
 
-    inline double angle2( const vec3f& v , const vec3f& w )
+    inline double angle2( const vec3& v , const vec3& w )
     {
-		vec3f a = v , b= *this;
+		vec3 a = v , b= *this;
 		double dot = a.x*b.x + a.y*b.y + a.z*b.z;
 		double len = a.length() * b.length();
 		if(len==0)len=1;
 
-		vec3f plane; plane.cross( b,w );
+		vec3 plane; plane.cross( b,w );
 
 		if ( plane.x * a.x + plane.y * a.y + plane.z * a.z > 0 )
 			return (double) -acos ( dot  / len );
@@ -130,14 +149,14 @@ struct vec3f
 		return (double) acos ( dot  / len );
 	}
 
-    inline vec3f rot_x( double a )
+    inline vec3 rot_x( double a )
     {
 		double yy = cos ( a ) * y + sin ( a ) * z;
 		double zz = cos ( a ) * z - sin ( a ) * y;
 		y = yy; z = zz;
 		return *this;
 	}
-    inline vec3f rot_y( double a )
+    inline vec3 rot_y( double a )
     {
 		double xx = cos ( -a ) * x + sin ( -a ) * z;
 		double zz = cos ( -a ) * z - sin ( -a ) * x;
@@ -153,43 +172,43 @@ struct vec3f
 		if (y>max) y=max;
 		if (z>max) z=max;
 	}
-    inline vec3f rot_z( double a )
+    inline vec3 rot_z( double a )
     {
 		double yy = cos ( a ) * y + sin ( a ) * x;
 		double xx = cos ( a ) * x - sin ( a ) * y;
 		y = yy; x = xx;
 		return *this;
 	}
-    inline vec3f invert()
+    inline vec3 invert()
 	{
 		x=-x;y=-y;z=-z;return *this;
 	}
-    inline vec3f frac()
+    inline vec3 frac()
 	{
-		return vec3f(
+		return vec3(
 			x-double(int(x)),
 			y-double(int(y)),
 			z-double(int(z))
 			);
 	}
 
-    inline vec3f integer()
+    inline vec3 integer()
 	{
-		return vec3f(
+		return vec3(
 			double(int(x)),
 			double(int(y)),
 			double(int(z))
 			);
 	}
 
-    inline double length() const
+    inline T length() const
     {
-		return (double)sqrt(x*x + y*y + z*z);
+		return (T)sqrt(x*x + y*y + z*z);
 	}
 
-    inline vec3f normalize( double desired_length = 1 )
+    inline vec3 normalize( double desired_length = 1 )
     {
-		double square = sqrt(x*x + y*y + z*z);
+		T square = sqrt(x*x + y*y + z*z);
 		/*
 		if (square <= 0.00001f )
 		{
@@ -201,11 +220,11 @@ struct vec3f
 
 		return *this;
 	}
-    static vec3f normalize( vec3f a );
+    static vec3 normalize( vec3 a );
 
 	static void random_init();
 	static double random_double();
-	static vec3f random();
+	static vec3 random();
 
 	static int random_number;
 
@@ -215,7 +234,7 @@ struct vec3f
 		return double(rni)/(100000.0f-1.0f);
 	}
 
-	vec3f random01_fxyz(){
+	vec3 random01_fxyz(){
 		x=(double)random_double_01(x);
 		y=(double)random_double_01(y);
 		z=(double)random_double_01(z);
@@ -223,11 +242,12 @@ struct vec3f
 	}
 
 };
+typedef vec3<double> vec3f;
 
-vec3f barycentric(const vec3f &p, const vec3f &a, const vec3f &b, const vec3f &c){
-	vec3f v0 = b-a;
-	vec3f v1 = c-a;
-	vec3f v2 = p-a;
+template<class T> vec3<T> barycentric(const vec3<T> &p, const vec3<T> &a, const vec3<T> &b, const vec3<T> &c){
+	vec3<T> v0 = b-a;
+	vec3<T> v1 = c-a;
+	vec3<T> v2 = p-a;
 	double d00 = v0.dot(v0);
 	double d01 = v0.dot(v1);
 	double d11 = v1.dot(v1);
@@ -237,13 +257,13 @@ vec3f barycentric(const vec3f &p, const vec3f &a, const vec3f &b, const vec3f &c
 	double v = (d11 * d20 - d01 * d21) / denom;
 	double w = (d00 * d21 - d01 * d20) / denom;
 	double u = 1.0 - v - w;
-	return vec3f(u,v,w);
+	return vec3<T>(u,v,w);
 }
 
-vec3f interpolate(const vec3f &p, const vec3f &a, const vec3f &b, const vec3f &c, const vec3f attrs[3])
+template<class T> vec3<T> interpolate(const vec3<T> &p, const vec3<T> &a, const vec3<T> &b, const vec3<T> &c, const vec3<T> attrs[3])
 {
-	vec3f bary = barycentric(p,a,b,c);
-	vec3f out = vec3f(0,0,0);
+	vec3<T> bary = barycentric(p,a,b,c);
+	vec3<T> out = vec3<T>(0,0,0);
 	out = out + attrs[0] * bary.x;
 	out = out + attrs[1] * bary.y;
 	out = out + attrs[2] * bary.z;
@@ -255,18 +275,18 @@ double min(double v1, double v2) {
 }
 
 
-class SymetricMatrix {
+template<class T> class SymetricMatrixT {
 
 	public:
 
 	// Constructor
 
-	SymetricMatrix(double c=0) { loopi(0,10) m[i] = c;  }
+	SymetricMatrixT(T c=0) { loopi(0,10) m[i] = c;  }
 
-	SymetricMatrix(	double m11, double m12, double m13, double m14,
-			            double m22, double m23, double m24,
-			                        double m33, double m34,
-			                                    double m44) {
+	SymetricMatrixT(	T m11, T m12, T m13, T m14,
+			            T m22, T m23, T m24,
+			                        T m33, T m34,
+			                                    T m44) {
 			 m[0] = m11;  m[1] = m12;  m[2] = m13;  m[3] = m14;
 			              m[4] = m22;  m[5] = m23;  m[6] = m24;
 			                           m[7] = m33;  m[8] = m34;
@@ -275,7 +295,7 @@ class SymetricMatrix {
 
 	// Make plane
 
-	SymetricMatrix(double a,double b,double c,double d)
+	SymetricMatrixT(T a,T b,T c,T d)
 	{
 		m[0] = a*a;  m[1] = a*b;  m[2] = a*c;  m[3] = a*d;
 		             m[4] = b*b;  m[5] = b*c;  m[6] = b*d;
@@ -283,28 +303,28 @@ class SymetricMatrix {
 		                                       m[9 ] = d*d;
 	}
 
-	double operator[](int c) const { return m[c]; }
+	T operator[](int c) const { return m[c]; }
 
 	// Determinant
 
-	double det(	int a11, int a12, int a13,
+	T det(	int a11, int a12, int a13,
 				int a21, int a22, int a23,
 				int a31, int a32, int a33)
 	{
-		double det =  m[a11]*m[a22]*m[a33] + m[a13]*m[a21]*m[a32] + m[a12]*m[a23]*m[a31]
+		T det =  m[a11]*m[a22]*m[a33] + m[a13]*m[a21]*m[a32] + m[a12]*m[a23]*m[a31]
 					- m[a13]*m[a22]*m[a31] - m[a11]*m[a23]*m[a32]- m[a12]*m[a21]*m[a33];
 		return det;
 	}
 
-	const SymetricMatrix operator+(const SymetricMatrix& n) const
+	const SymetricMatrixT operator+(const SymetricMatrixT& n) const
 	{
-		return SymetricMatrix( m[0]+n[0],   m[1]+n[1],   m[2]+n[2],   m[3]+n[3],
+		return SymetricMatrixT( m[0]+n[0],   m[1]+n[1],   m[2]+n[2],   m[3]+n[3],
 						                    m[4]+n[4],   m[5]+n[5],   m[6]+n[6],
 						                                 m[ 7]+n[ 7], m[ 8]+n[8 ],
 						                                              m[ 9]+n[9 ]);
 	}
 
-	SymetricMatrix& operator+=(const SymetricMatrix& n)
+	SymetricMatrixT& operator+=(const SymetricMatrixT& n)
 	{
 		 m[0]+=n[0];   m[1]+=n[1];   m[2]+=n[2];   m[3]+=n[3];
 		 m[4]+=n[4];   m[5]+=n[5];   m[6]+=n[6];   m[7]+=n[7];
@@ -312,12 +332,195 @@ class SymetricMatrix {
 		return *this;
 	}
 
-	double m[10];
+	T m[10];
 };
-///////////////////////////////////////////
+typedef SymetricMatrixT<double> SymetricMatrix;
+
+// The triangles around a vertex that a collapse keeps, gathered for
+// flipped_n: far corners a and b and the normal n, one array each (SoA)
+const int FLIP_BLOCK = 8;
+template<class T> struct FlipBlock {
+	T ax[FLIP_BLOCK], ay[FLIP_BLOCK], az[FLIP_BLOCK];
+	T bx[FLIP_BLOCK], by[FLIP_BLOCK], bz[FLIP_BLOCK];
+	T nx[FLIP_BLOCK], ny[FLIP_BLOCK], nz[FLIP_BLOCK];
+};
+
+// Triangle i of f with its first corner moved to p: true if its angle at p
+// is nearly 0 or 180 degrees (|cos| > parallel), or its normal turns from n
+// by more than the limit (cos < dot). Both sides of each comparison are
+// taken times the lengths involved, squared, so nothing is normalized.
+template<class T> inline bool flipped_at(const FlipBlock<T> &f, int i, T px, T py, T pz, T dot, T parallel)
+{
+	T d1x=f.ax[i]-px, d1y=f.ay[i]-py, d1z=f.az[i]-pz;
+	T d2x=f.bx[i]-px, d2y=f.by[i]-py, d2z=f.bz[i]-pz;
+	T l1=d1x*d1x + d1y*d1y + d1z*d1z, l2=d2x*d2x + d2y*d2y + d2z*d2z;
+	T c=d1x*d2x + d1y*d2y + d1z*d2z;
+	if(c*c > parallel*parallel*l1*l2) return true;
+	T nx=d1y*d2z - d1z*d2y, ny=d1z*d2x - d1x*d2z, nz=d1x*d2y - d1y*d2x;
+	T m=f.nx[i]*nx + f.ny[i]*ny + f.nz[i]*nz, ln=nx*nx + ny*ny + nz*nz;
+	// m < dot*|n|
+	return dot>=0 ? m<0 || m*m < dot*dot*ln : m<0 && m*m > dot*dot*ln;
+}
+
+// True if one of the n triangles of f flips (flipped_at)
+template<class T> bool flipped_n(const FlipBlock<T> &f, int n, T px, T py, T pz, T dot, T parallel)
+{
+	for (int i = 0; i < n; i++) if (flipped_at(f, i, px, py, pz, dot, parallel)) return true;
+	return false;
+}
+
+#ifdef FALLOFF_SSE2
+// Double positions: flipped_at two triangles at a time
+inline bool flipped_n_sse2(const FlipBlock<double> &f, int n, double px, double py, double pz, double dot, double parallel)
+{
+	int i = 0;
+	const __m128d x0 = _mm_set1_pd(px), y0 = _mm_set1_pd(py), z0 = _mm_set1_pd(pz);
+	const __m128d par2 = _mm_set1_pd(parallel*parallel), dot2 = _mm_set1_pd(dot*dot), zero = _mm_setzero_pd();
+	const __m128d dotNeg = dot >= 0 ? _mm_setzero_pd() : _mm_castsi128_pd(_mm_set1_epi32(-1));
+	for (; i + 2 <= n; i += 2) {
+		__m128d d1x = _mm_sub_pd(_mm_loadu_pd(f.ax+i), x0);
+		__m128d d1y = _mm_sub_pd(_mm_loadu_pd(f.ay+i), y0);
+		__m128d d1z = _mm_sub_pd(_mm_loadu_pd(f.az+i), z0);
+		__m128d d2x = _mm_sub_pd(_mm_loadu_pd(f.bx+i), x0);
+		__m128d d2y = _mm_sub_pd(_mm_loadu_pd(f.by+i), y0);
+		__m128d d2z = _mm_sub_pd(_mm_loadu_pd(f.bz+i), z0);
+		__m128d l1 = _mm_add_pd(_mm_add_pd(_mm_mul_pd(d1x, d1x), _mm_mul_pd(d1y, d1y)), _mm_mul_pd(d1z, d1z));
+		__m128d l2 = _mm_add_pd(_mm_add_pd(_mm_mul_pd(d2x, d2x), _mm_mul_pd(d2y, d2y)), _mm_mul_pd(d2z, d2z));
+		__m128d c = _mm_add_pd(_mm_add_pd(_mm_mul_pd(d1x, d2x), _mm_mul_pd(d1y, d2y)), _mm_mul_pd(d1z, d2z));
+		__m128d bad = _mm_cmpgt_pd(_mm_mul_pd(c, c), _mm_mul_pd(_mm_mul_pd(par2, l1), l2));
+		__m128d nx = _mm_sub_pd(_mm_mul_pd(d1y, d2z), _mm_mul_pd(d1z, d2y));
+		__m128d ny = _mm_sub_pd(_mm_mul_pd(d1z, d2x), _mm_mul_pd(d1x, d2z));
+		__m128d nz = _mm_sub_pd(_mm_mul_pd(d1x, d2y), _mm_mul_pd(d1y, d2x));
+		__m128d m = _mm_add_pd(_mm_add_pd(_mm_mul_pd(_mm_loadu_pd(f.nx+i), nx), _mm_mul_pd(_mm_loadu_pd(f.ny+i), ny)),
+			_mm_mul_pd(_mm_loadu_pd(f.nz+i), nz));
+		__m128d ln = _mm_add_pd(_mm_add_pd(_mm_mul_pd(nx, nx), _mm_mul_pd(ny, ny)), _mm_mul_pd(nz, nz));
+		__m128d neg = _mm_cmplt_pd(m, zero);
+		__m128d m2 = _mm_mul_pd(m, m), lim = _mm_mul_pd(dot2, ln);
+		// dot >= 0: m<0 or m*m < dot*dot*ln; dot < 0: m<0 and m*m > dot*dot*ln
+		__m128d turned = _mm_or_pd(_mm_andnot_pd(dotNeg, _mm_or_pd(neg, _mm_cmplt_pd(m2, lim))),
+			_mm_and_pd(dotNeg, _mm_and_pd(neg, _mm_cmpgt_pd(m2, lim))));
+		if (_mm_movemask_pd(_mm_or_pd(bad, turned))) return true;
+	}
+	for (; i < n; i++) if (flipped_at(f, i, px, py, pz, dot, parallel)) return true;
+	return false;
+}
+#endif
 
-namespace Simplify
+#ifdef SIMD_DISPATCH
+// Four at a time
+SIMD_TARGET("avx2") bool flipped_n_avx2(const FlipBlock<double> &f, int n, double px, double py, double pz, double dot, double parallel)
+{
+	int i = 0;
+	const __m256d x0 = _mm256_set1_pd(px), y0 = _mm256_set1_pd(py), z0 = _mm256_set1_pd(pz);
+	const __m256d par2 = _mm256_set1_pd(parallel*parallel), dot2 = _mm256_set1_pd(dot*dot), zero = _mm256_setzero_pd();
+	for (; i + 4 <= n; i += 4) {
+		__m256d d1x = _mm256_sub_pd(_mm256_loadu_pd(f.ax+i), x0);
+		__m256d d1y = _mm256_sub_pd(_mm256_loadu_pd(f.ay+i), y0);
+		__m256d d1z = _mm256_sub_pd(_mm256_loadu_pd(f.az+i), z0);
+		__m256d d2x = _mm256_sub_pd(_mm256_loadu_pd(f.bx+i), x0);
+		__m256d d2y = _mm256_sub_pd(_mm256_loadu_pd(f.by+i), y0);
+		__m256d d2z = _mm256_sub_pd(_mm256_loadu_pd(f.bz+i), z0);
+		__m256d l1 = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(d1x, d1x), _mm256_mul_pd(d1y, d1y)), _mm256_mul_pd(d1z, d1z));
+		__m256d l2 = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(d2x, d2x), _mm256_mul_pd(d2y, d2y)), _mm256_mul_pd(d2z, d2z));
+		__m256d c = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(d1x, d2x), _mm256_mul_pd(d1y, d2y)), _mm256_mul_pd(d1z, d2z));
+		__m256d bad = _mm256_cmp_pd(_mm256_mul_pd(c, c), _mm256_mul_pd(_mm256_mul_pd(par2, l1), l2), _CMP_GT_OQ);
+		__m256d nx = _mm256_sub_pd(_mm256_mul_pd(d1y, d2z), _mm256_mul_pd(d1z, d2y));
+		__m256d ny = _mm256_sub_pd(_mm256_mul_pd(d1z, d2x), _mm256_mul_pd(d1x, d2z));
+		__m256d nz = _mm256_sub_pd(_mm256_mul_pd(d1x, d2y), _mm256_mul_pd(d1y, d2x));
+		__m256d m = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(_mm256_loadu_pd(f.nx+i), nx), _mm256_mul_pd(_mm256_loadu_pd(f.ny+i), ny)),
+			_mm256_mul_pd(_mm256_loadu_pd(f.nz+i), nz));
+		__m256d ln = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(nx, nx), _mm256_mul_pd(ny, ny)), _mm256_mul_pd(nz, nz));
+		__m256d neg = _mm256_cmp_pd(m, zero, _CMP_LT_OQ);
+		__m256d m2 = _mm256_mul_pd(m, m), lim = _mm256_mul_pd(dot2, ln);
+		__m256d turned = dot >= 0 ? _mm256_or_pd(neg, _mm256_cmp_pd(m2, lim, _CMP_LT_OQ))
+			: _mm256_and_pd(neg, _mm256_cmp_pd(m2, lim, _CMP_GT_OQ));
+		if (_mm256_movemask_pd(_mm256_or_pd(bad, turned))) return true;
+	}
+	for (; i < n; i++) if (flipped_at(f, i, px, py, pz, dot, parallel)) return true;
+	return false;
+}
+
+// A whole FlipBlock at once, n lanes live
+SIMD_TARGET("avx512f") bool flipped_n_avx512(const FlipBlock<double> &f, int n, double px, double py, double pz, double dot, double parallel)
+{
+	const __mmask8 live = n >= 8 ? 0xff : (1 << n) - 1;
+	const __m512d x0 = _mm512_set1_pd(px), y0 = _mm512_set1_pd(py), z0 = _mm512_set1_pd(pz);
+	const __m512d par2 = _mm512_set1_pd(parallel*parallel), dot2 = _mm512_set1_pd(dot*dot);
+	__m512d d1x = _mm512_sub_pd(_mm512_maskz_loadu_pd(live, f.ax), x0);
+	__m512d d1y = _mm512_sub_pd(_mm512_maskz_loadu_pd(live, f.ay), y0);
+	__m512d d1z = _mm512_sub_pd(_mm512_maskz_loadu_pd(live, f.az), z0);
+	__m512d d2x = _mm512_sub_pd(_mm512_maskz_loadu_pd(live, f.bx), x0);
+	__m512d d2y = _mm512_sub_pd(_mm512_maskz_loadu_pd(live, f.by), y0);
+	__m512d d2z = _mm512_sub_pd(_mm512_maskz_loadu_pd(live, f.bz), z0);
+	__m512d l1 = _mm512_add_pd(_mm512_add_pd(_mm512_mul_pd(d1x, d1x), _mm512_mul_pd(d1y, d1y)), _mm512_mul_pd(d1z, d1z));
+	__m512d l2 = _mm512_add_pd(_mm512_add_pd(_mm512_mul_pd(d2x, d2x), _mm512_mul_pd(d2y, d2y)), _mm512_mul_pd(d2z, d2z));
+	__m512d c = _mm512_add_pd(_mm512_add_pd(_mm512_mul_pd(d1x, d2x), _mm512_mul_pd(d1y, d2y)), _mm512_mul_pd(d1z, d2z));
+	__mmask8 bad = _mm512_mask_cmp_pd_mask(live, _mm512_mul_pd(c, c), _mm512_mul_pd(_mm512_mul_pd(par2, l1), l2), _CMP_GT_OQ);
+	if (bad) return true;
+	__m512d nx = _mm512_sub_pd(_mm512_mul_pd(d1y, d2z), _mm512_mul_pd(d1z, d2y));
+	__m512d ny = _mm512_sub_pd(_mm512_mul_pd(d1z, d2x), _mm512_mul_pd(d1x, d2z));
+	__m512d nz = _mm512_sub_pd(_mm512_mul_pd(d1x, d2y), _mm512_mul_pd(d1y, d2x));
+	__m512d m = _mm512_add_pd(_mm512_add_pd(_mm512_mul_pd(_mm512_maskz_loadu_pd(live, f.nx), nx), _mm512_mul_pd(_mm512_maskz_loadu_pd(live, f.ny), ny)),
+		_mm512_mul_pd(_mm512_maskz_loadu_pd(live, f.nz), nz));
+	__m512d ln = _mm512_add_pd(_mm512_add_pd(_mm512_mul_pd(nx, nx), _mm512_mul_pd(ny, ny)), _mm512_mul_pd(nz, nz));
+	__mmask8 neg = _mm512_mask_cmp_pd_mask(live, m, _mm512_setzero_pd(), _CMP_LT_OQ);
+	__m512d m2 = _mm512_mul_pd(m, m), lim = _mm512_mul_pd(dot2, ln);
+	if (dot >= 0) return (neg | _mm512_mask_cmp_pd_mask(live, m2, lim, _CMP_LT_OQ)) != 0;
+	return _mm512_mask_cmp_pd_mask(neg, m2, lim, _CMP_GT_OQ) != 0;
+}
+#endif
+
+// Double positions: the widest kernel simdLevel allows
+inline bool flipped_n(const FlipBlock<double> &f, int n, double px, double py, double pz, double dot, double parallel)
+{
+#ifdef SIMD_DISPATCH
+	if (simdLevel == SIMD_AVX512) return flipped_n_avx512(f, n, px, py, pz, dot, parallel);
+	if (simdLevel == SIMD_AVX2) return flipped_n_avx2(f, n, px, py, pz, dot, parallel);
+#endif
+#ifdef FALLOFF_SSE2
+	if (simdLevel >= SIMD_SSE2) return flipped_n_sse2(f, n, px, py, pz, dot, parallel);
+#endif
+	return flipped_n<double>(f, n, px, py, pz, dot, parallel);
+}
+
+// Set from a signal handler (SIGTERM in Main.cpp) to make simplify_mesh stop
+// early, in any engine, and return the mesh it has
+volatile sig_atomic_t simplifyStopRequested = 0;
+#endif // SIMPLIFY_COMMON_H
+///////////////////////////////////////////
+//
+// The engine below may be included more than once, each time into its own
+// namespace and with its own scalar types:
+//
+//   SIMPLIFY_NAMESPACE  namespace of the engine (default Simplify)
+//   SIMPLIFY_POSITION   positions, normals and uvs (default double)
+//   SIMPLIFY_QUADRIC    quadrics and collapse errors (default double)
+//   SIMPLIFY_MEMORYLESS if defined, vertices keep no quadric and collapse costs
+//                       come from the current geometry (see calculate_error)
+//
+// e.g. float positions with double quadrics:
+//
+//   #define SIMPLIFY_NAMESPACE SimplifyMixed
+//   #define SIMPLIFY_POSITION float
+//   #include "Simplify.h"
+
+#ifndef SIMPLIFY_NAMESPACE
+#define SIMPLIFY_NAMESPACE Simplify
+#endif
+#ifndef SIMPLIFY_POSITION
+#define SIMPLIFY_POSITION double
+#endif
+#ifndef SIMPLIFY_QUADRIC
+#define SIMPLIFY_QUADRIC double
+#endif
+
+namespace SIMPLIFY_NAMESPACE
 {
+	typedef SIMPLIFY_POSITION Real;
+	typedef SIMPLIFY_QUADRIC QReal;
+	typedef vec3<Real> vec3f;
+	typedef SymetricMatrixT<QReal> SymetricMatrix;
+
 	// Global Variables & Strctures
 	enum Attributes {
 		NONE,
@@ -325,14 +528,22 @@ namespace Simplify
 		TEXCOORD = 4,
 		COLOR = 8
 	};
-	struct Triangle { int v[3];double err[4];int deleted,dirty,attr;vec3f n;vec3f uvs[3];int material; };
+	struct Triangle { int v[3];QReal err[4];int deleted,dirty,attr;vec3f n;vec3f uvs[3];int material; };
+#ifdef SIMPLIFY_MEMORYLESS
+	struct Vertex { vec3f p;int tstart,tcount;int border;};
+#else
 	struct Vertex { vec3f p;int tstart,tcount;SymetricMatrix q;int border;};
+#endif
+	// Vertex::border: 1 on an open edge, BORDER_LOCKED never collapses
+	enum { BORDER_LOCKED = 2 };
 	struct Ref { int tid,tvertex; };
+	// triangle order, as the full refs build in update_mesh gives
+	inline bool operator<(const Ref &a, const Ref &b) { return a.tid<b.tid || (a.tid==b.tid && a.tvertex<b.tvertex); }
 	struct Region {
 		double regionTarget;
 		bool regionBound;
 		double (*func)(double, double, double, double, double, double, double, double, bool);
-		vec3f coord;
+		vec3<double> coord;
 		double radius;
 		double scale;
 		double power;
@@ -340,11 +551,53 @@ namespace Simplify
 		bool done;
 		int startCount;
 		int endCount;
+		Falloff falloff;  // func with the parameters above
+		Falloff bound;    // square with the parameters above, for regionBound
+		double reach;     // beyond this distance the factor is outsideFactor; < 0 if unbounded
+		double outsideFactor;
 	};
 	std::vector<Region> regions;
+
+	void init_region_falloff(Region &r) {
+		r.falloff = make_falloff(r.func, r.coord.x, r.coord.y, r.coord.z, r.radius, r.scale, r.isNegative);
+		r.bound = make_falloff(square, r.coord.x, r.coord.y, r.coord.z, r.radius, r.scale, r.isNegative);
+	}
 	std::vector<Triangle> triangles;
 	std::vector<Vertex> vertices;
 	std::vector<Ref> refs;
+	// Refs arena: slots left behind by collapses, by size class; a slot in
+	// refFree[c] holds 2^c to 2^(c+1)-1 refs. Emptied by update_mesh.
+	struct RefSlot { int tstart,size; };
+	enum { REF_CLASSES = 16 };
+	std::vector<RefSlot> refFree[REF_CLASSES];
+
+	// Memory: the loaders reserve the big arrays from the file size, and with
+	// hugePages (-H) those arrays are advised to use transparent huge pages.
+	bool hugePages = false;
+
+	size_t file_size(FILE *fn)
+	{
+		long pos=ftell(fn);
+		if(fseek(fn,0,SEEK_END)!=0) return 0;
+		long n=ftell(fn);
+		fseek(fn,pos,SEEK_SET);
+		return n>0 ? size_t(n) : 0;
+	}
+
+	template<class T> void advise_huge_pages(std::vector<T> &v)
+	{
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+		const size_t page=size_t(1)<<21;
+		size_t bytes=v.capacity()*sizeof(T);
+		if(!hugePages || bytes<2*page) return;
+		size_t lo=((size_t)v.data()+page-1)&~(page-1), hi=((size_t)v.data()+bytes)&~(page-1);
+		if(lo<hi) madvise((void*)lo, hi-lo, MADV_HUGEPAGE);
+#else
+		(void)v;
+#endif
+	}
+
+	template<class T> void free_vector(std::vector<T> &v) { std::vector<T>().swap(v); }
     std::string mtllib;
     std::vector<std::string> materials;
 
@@ -447,14 +700,110 @@ namespace Simplify
 
 	// Helper functions
 
-	double vertex_error(SymetricMatrix q, double x, double y, double z);
-	double calculate_error(int , int , vec3f &);
+	QReal vertex_error(SymetricMatrix q, QReal x, QReal y, QReal z);
+	QReal calculate_error(int , int , vec3f &);
+	void update_errors(int i0);
 	bool flipped(vec3f p,int i0,int i1,Vertex &v0,Vertex &v1,std::vector<int> &deleted);
 	void update_uvs(int i0,const Vertex &v,const vec3f &p,std::vector<int> &deleted);
 	void update_triangles(int i0,Vertex &v,std::vector<int> &deleted,int &deleted_triangles);
 	void update_mesh(int iteration);
 	void compact_mesh();
+	void store_refs(Vertex &v0, Vertex &v1, int tstart, int tcount);
+	void free_refs(int tstart, int size);
+	bool rebuild_due(int live_triangles);
+	int exclusive_scan(int *a, int n);
+	void compact_triangles();
+	// Scratch for the rebuilds in update_mesh and compact_mesh, kept between calls
+	std::vector<int> scanBlocks, triangleRemap, vertexRemap;
+	std::vector<Triangle> triangleScratch;
+	std::vector<Ref> refScratch;
+	// The first lockedVertexCount vertices get border=BORDER_LOCKED in update_mesh(0)
+	int lockedVertexCount = 0;
+	// Boundary quadrics: with borderWeight > 0 every open edge adds the plane
+	// through it perpendicular to its triangle, times borderWeight, to the
+	// quadrics of its ends. Border vertices are then held to the boundary by
+	// their quadric instead of by the border checks, so edges from the inside
+	// to the border and along it collapse and open meshes keep simplifying.
+	// Not in the memoryless engine, whose costs include the boundary already.
+	double borderWeight = 0;
+	std::vector<int> linkScratch;
+	bool link_condition(int i0, int i1, bool border);
 	int consecutiveNoDeletionThreshold = 10000;
+	// Wall-clock deadline (set_deadline_ms), checked between passes and every
+	// few thousand triangles within one; stoppedEarly tells whether it or
+	// simplifyStopRequested ended the last simplify_mesh before its target
+	bool hasDeadline = false;
+	std::chrono::steady_clock::time_point deadline;
+	bool stoppedEarly = false;
+	void set_deadline_ms(double ms);
+	bool out_of_time();
+	// Error-bounded simplification: with maxError > 0 no collapse costs more
+	// than (maxError*diagonal)^2, diagonal being that of the bounding box, and
+	// simplify_mesh stops once a pass at that bound removes nothing, even if
+	// target_count is not reached. The errors of the collapses made are
+	// summarised in collapseCount, collapseErrorMax and collapseErrorSum.
+	double maxError = 0;
+	double errorBound = DBL_MAX;
+	int collapseCount = 0;
+	double collapseErrorMax = 0, collapseErrorSum = 0;
+	double bounding_diagonal();
+	// Adaptive threshold schedule: with adaptiveFraction > 0 each pass aims to
+	// remove that fraction of the triangles left above target_count, its
+	// threshold being the matching quantile of the edge errors of a sample of
+	// live triangles, instead of 1e-9*(iteration+3)^agressiveness. The number
+	// of passes then no longer depends on the units of the model.
+	double adaptiveFraction = 0;
+	const int ERROR_SAMPLE = 16384;
+	std::vector<double> errorSample;
+	double error_quantile(double q);
+	// Exact finish: with heapMargin > 0 (uniform and -f reduction) the
+	// threshold passes stop as soon as the count is within heapMargin of the
+	// target, and the rest is collapsed cheapest edge first from a priority
+	// queue, so the result lands on the target instead of below it.
+	double heapMargin = 0;
+	bool stopPassAtTarget = false;
+	struct HeapEdge {
+		double err;
+		int tid, j, v0, v1;
+		bool operator<(const HeapEdge &e) const { return err > e.err; } // min-heap
+	};
+	std::vector<HeapEdge> edgeHeap;
+	// Lossless mode (simplify_mesh_lossless) collapses the edges whose error
+	// is below (losslessTolerance*diagonal)^2, zero up to rounding whatever
+	// the scale and placement of the model. Collapses then keep one of the
+	// two vertices where it is (keepEndpoints), as near zero the choice of
+	// any other position would be left to rounding noise.
+	double losslessTolerance = 1e-6;
+	bool keepEndpoints = false;
+	std::vector<int> losslessWork;
+	std::vector<char> losslessQueued;
+	// Stall handling. collapse_edge counts why candidates are rejected. When
+	// a pass deletes nothing, simplify_mesh skips to the pass whose threshold
+	// admits another edge; once every edge has been tried and rejected (with
+	// -A, after stallPasses passes without new candidates) it relaxes the
+	// flip limits once, and then gives up.
+	int rejectBorder = 0, rejectFlip = 0, rejectBound = 0;
+	int stallPasses = 8;
+	double flipNormalDot = 0.2, flipParallel = 0.999; // limits of flipped()
+	// A collapse rejected by flipped() is remembered on its triangle edge:
+	// flipMemo holds flipClock+1 at the rejection, and it stands while no
+	// later collapse has changed a triangle around either end (ringClock, the
+	// flipClock of the last change). On high-valence meshes the same edges are
+	// rejected pass after pass, each time walking a large ring. Cleared by
+	// update_mesh, which renumbers the triangles, and when the limits change.
+	std::vector<int> flipMemo, ringClock;
+	int flipClock = 0;
+	// Smallest edge error, over the threshold factor, that the last full
+	// collapse_pass left at or above its threshold (DBL_MAX if none). After a
+	// pass that deleted nothing, the next pass with a threshold above it is the
+	// first that can do anything.
+	double passNextError = DBL_MAX;
+	// Planar regions (retriangulate_planar): polygons of more corners than this
+	// are left to the collapses, ear clipping being quadratic
+	const size_t PLANAR_MAX_LOOP = 4096;
+	bool triangulate_loops(const std::vector<int> &corners, const std::vector<int> &starts, const std::vector<int> &runs,
+		const vec3<double> &n, double tol, std::vector<int> &tris);
+	void keep_run(const std::vector<int> &run, double tol, std::vector<char> &keep);
 	int initialTotalCount = 0;
 	int initialRegionCount = 0;
 	int currentRegionCount = 0;
@@ -467,10 +816,373 @@ namespace Simplify
 	double magnification;
 	int load_txt(const char* filename, bool verbose);
 	bool inRegion(Triangle &t, double coord[], double radius);
-	double thresholdRegionsBound(Triangle &t, double &threshold0);
-	double thresholdAllCenters(Triangle &t, double &threshold0);
+	// Per-vertex threshold factor, depends on vertex position only.
+	// Filled once in simplify_mesh and refreshed for the surviving vertex of a collapse.
+	enum FactorMode {
+		FACTOR_NONE,
+		FACTOR_SINGLE,        // -f with -c/-r/-s/-p, described by factorFunc
+		FACTOR_ALL_CENTERS,   // -L, no bound regions
+		FACTOR_REGIONS_BOUND  // -L, some regions bound
+	};
+	int factorMode = FACTOR_NONE;
+	Region factorFunc;
+	std::vector<double> vertexFactor;
+	double vertex_factor(const vec3f &p);
+	void vertex_factors_n(const double *x, const double *y, const double *z, int n, double *out);
+	void init_vertex_factors();
+	// Vertices are gathered into SoA blocks of this size for the falloff kernels
+	const int FALLOFF_BLOCK = 256;
 	int currentCountInRegion(Region &region0);
 	bool allRegionsDone();
+	// Per-vertex region membership: regionWords 64-bit words per vertex, bit r set if inside regions[r].
+	// regions[r].endCount is kept up to date by update_triangles while regionWords > 0.
+	std::vector<unsigned long long> regionBits, regionScratch;
+	int regionWords = 0;
+	void region_bits(const vec3f &p, unsigned long long *bits);
+	void region_bits_n(int c, const double *x, const double *y, const double *z, int n, unsigned long long *bits);
+	void init_region_counters();
+	// Uniform grid over the reach spheres of the regions. A position only evaluates the
+	// regions listed in its cell and those of unbounded reach; all others contribute
+	// their outsideFactor, which is 0 or 1.
+	struct RegionGrid {
+		vec3<double> lo;
+		double cell;
+		int nx, ny, nz;
+		std::vector<int> cellStart, cellRegions;
+		std::vector<int> unbounded;
+		int zeroOutside; // regions kept in cells whose outsideFactor is 0
+	};
+	RegionGrid regionGrid;
+	void build_region_grid();
+	int region_grid_cell(const vec3f &p);
+	void region_cell_blocks(std::vector<int> &order, std::vector<int> &blockStart, std::vector<int> &blockCell);
+	void region_factor_n(const Region &r, const double *x, const double *y, const double *z, int n, double *out, double *tmp);
+	void region_factors_n(int c, const double *x, const double *y, const double *z, int n, double *out, double *tmp);
+	double region_grid_factor(const vec3f &p);
+	void count_region_triangle(const Triangle &t, int delta, int i0=-1, const unsigned long long *i0bits=NULL);
+	bool region_triangle_inside(const Triangle &t, int region);
+	bool region_vertex_inside(int vid, int region);
+	//
+	// Threshold policies of collapse_pass. Every combination is compiled
+	// as its own loop, so the per-triangle work carries no mode branches.
+	//
+
+	// Whole mesh, constant function
+	struct UniformThreshold {
+		static inline double get(const Triangle &t, double threshold0) { return threshold0; }
+		static inline double factor(const Triangle &t) { return 1; }
+		static inline void moved(int vid, const vec3f &p) {}
+	};
+
+	// Whole mesh with -f, or multiple centers (-L): cached vertexFactor
+	struct FactorThreshold {
+		static inline double get(const Triangle &t, double threshold0) { return threshold0*vertexFactor[t.v[0]]; }
+		static inline double factor(const Triangle &t) { return vertexFactor[t.v[0]]; }
+		static inline void moved(int vid, const vec3f &p) { vertexFactor[vid] = vertex_factor(p); }
+	};
+
+	// Single region (-T) once its target is reached: nothing inside regions[0] collapses
+	template<class Outside> struct RegionLockedThreshold {
+		static inline double get(const Triangle &t, double threshold0) {
+			if (region_triangle_inside(t, 0) || region_vertex_inside(t.v[0], 0)) return 0;
+			return Outside::get(t, threshold0);
+		}
+		// of a triangle that get() does not lock
+		static inline double factor(const Triangle &t) { return Outside::factor(t); }
+		static inline void moved(int vid, const vec3f &p) { Outside::moved(vid, p); }
+	};
+
+	// Collapses edge j of t unless its ends differ in border class, its error
+	// is over the bound or a triangle around it would flip.
+	// Returns true if it was collapsed.
+	template<class Threshold, bool Textured>
+	inline bool collapse_edge(Triangle &t, int j, int &deleted_triangles,
+		std::vector<int> &deleted0, std::vector<int> &deleted1)
+	{
+		int i0=t.v[ j     ]; Vertex &v0 = vertices[i0];
+		int i1=t.v[(j+1)%3]; Vertex &v1 = vertices[i1];
+		// Border check
+		if(v0.border == BORDER_LOCKED || v1.border == BORDER_LOCKED ||
+			(v0.border != v1.border && !(borderWeight > 0))) { rejectBorder++; return false; }
+		// with boundary quadrics the border checks above no longer keep the
+		// boundary manifold, the link condition does
+		if(borderWeight > 0 && (v0.border || v1.border) && !link_condition(i0,i1,v0.border && v1.border)) { rejectBorder++; return false; }
+
+		// rejected before, and nothing around changed since
+		int &memo=flipMemo[(&t-&triangles[0])*3+j];
+		if(memo>ringClock[i0] && memo>ringClock[i1]) { rejectFlip++; return false; }
+
+		// Compute vertex to collapse to
+		vec3f p;
+		double error=calculate_error(i0,i1,p);
+		if(error>errorBound) { rejectBound++; return false; }
+		deleted0.resize(v0.tcount); // normals temporarily
+		deleted1.resize(v1.tcount); // normals temporarily
+		// don't remove if flipped
+		if( flipped(p,i0,i1,v0,v1,deleted0) || flipped(p,i1,i0,v1,v0,deleted1) ) { memo=flipClock+1; rejectFlip++; return false; }
+
+		if ( Textured && (t.attr & TEXCOORD) == TEXCOORD  )
+		{
+			update_uvs(i0,v0,p,deleted0);
+			update_uvs(i0,v1,p,deleted1);
+		}
+
+		// not flipped, so remove edge
+		v0.p=p;
+#ifndef SIMPLIFY_MEMORYLESS
+		v0.q=v1.q+v0.q;
+#endif
+		v0.border|=v1.border; // an inner vertex merged into the border
+		int tstart=refs.size();
+
+		flipClock++;
+		update_triangles(i0,v0,deleted0,deleted_triangles);
+		update_triangles(i0,v1,deleted1,deleted_triangles);
+
+		int tcount=refs.size()-tstart;
+		if(regionWords) region_bits(v0.p, &regionBits[i0*regionWords]);
+		Threshold::moved(i0, v0.p);
+
+		store_refs(v0,v1,tstart,tcount);
+		update_errors(i0);
+		collapseCount++;
+		error=std::max(error,0.0); // rounding in float quadrics
+		collapseErrorSum+=error;
+		collapseErrorMax=std::max(collapseErrorMax,error);
+		return true;
+	}
+
+	// One pass over all triangles, collapsing edges whose error is below the threshold.
+	// Returns true once the target count is reached. Also sets passNextError.
+	template<class Threshold, bool Textured>
+	bool collapse_pass(double threshold0, int triangle_count, int target_count, int &deleted_triangles,
+		std::vector<int> &deleted0, std::vector<int> &deleted1)
+	{
+		bool breakIteration = false;
+		double next = DBL_MAX;
+		// remove vertices & mark deleted triangles
+		loopi(0,triangles.size())
+		{
+			if((i&4095)==0 && out_of_time()) return true;
+			Triangle &t=triangles[i];
+			if(t.deleted) continue;
+			if(t.dirty) continue;
+
+			double threshold = Threshold::get(t, threshold0);
+			if(t.err[3]>threshold)
+			{
+				if(threshold>0) next=std::min(next, t.err[3]/Threshold::factor(t));
+				continue;
+			}
+
+			loopj(0,3)if(t.err[j]<threshold)
+			{
+				if(collapse_edge<Threshold, Textured>(t,j,deleted_triangles,deleted0,deleted1)) break;
+			}
+			else if(threshold>0) next=std::min(next, t.err[j]/Threshold::factor(t));
+			// done?
+			if(!breakIteration && (triangle_count-deleted_triangles<=target_count)) {
+				breakIteration = true; // may delete entire mesh
+				if(stopPassAtTarget) break;
+			}
+		}
+		passNextError = next;
+		return breakIteration;
+	}
+
+	// Queues the edges of triangle tid, keyed by error over the threshold factor
+	template<class Threshold>
+	inline void push_edges(int tid)
+	{
+		const Triangle &t=triangles[tid];
+		double factor=Threshold::get(t, 1.0);
+		if(factor<=0) return;
+		loopj(0,3)
+		{
+			HeapEdge e={t.err[j]/factor, tid, j, t.v[j], t.v[(j+1)%3]};
+			edgeHeap.push_back(e);
+			std::push_heap(edgeHeap.begin(), edgeHeap.end());
+		}
+	}
+
+	// Collapses the cheapest edges one at a time until target_count is reached.
+	// Entries go stale when a collapse touches their triangle; those around the
+	// surviving vertex are queued again with their new errors.
+	template<class Threshold, bool Textured>
+	void heap_finish(int triangle_count, int target_count, int &deleted_triangles,
+		std::vector<int> &deleted0, std::vector<int> &deleted1)
+	{
+		edgeHeap.clear();
+		loopi(0,triangles.size()) if(!triangles[i].deleted) push_edges<Threshold>(i);
+		int pops=0;
+		while(!edgeHeap.empty() && triangle_count-deleted_triangles>target_count)
+		{
+			if((++pops&4095)==0 && out_of_time()) break;
+			std::pop_heap(edgeHeap.begin(), edgeHeap.end());
+			HeapEdge e=edgeHeap.back();
+			edgeHeap.pop_back();
+			Triangle &t=triangles[e.tid];
+			if(t.deleted || t.v[e.j]!=e.v0 || t.v[(e.j+1)%3]!=e.v1) continue;
+			if(t.err[e.j]/Threshold::get(t, 1.0)!=e.err) continue;
+			if(!collapse_edge<Threshold, Textured>(t,e.j,deleted_triangles,deleted0,deleted1)) continue;
+			const Vertex &v=vertices[e.v0];
+			loopk(0,v.tcount)
+			{
+				int tid=refs[v.tstart+k].tid;
+				if(!triangles[tid].deleted) push_edges<Threshold>(tid);
+			}
+		}
+		free_vector(edgeHeap);
+	}
+
+	// Collapses every edge below errorBound. The worklist holds the triangles
+	// that have such an edge, each at most once; after a collapse only the
+	// triangles around the surviving vertex are queued again, since no other
+	// error changed.
+	template<bool Textured>
+	void lossless_worklist(int &deleted_triangles, std::vector<int> &deleted0, std::vector<int> &deleted1)
+	{
+		std::vector<int> &work=losslessWork;
+		std::vector<char> &queued=losslessQueued;
+		work.clear();
+		queued.assign(triangles.size(), 0);
+		// popped from the back, so the mesh is worked through in its order
+		for(int i=int(triangles.size())-1; i>=0; i--)
+		{
+			if(triangles[i].deleted || triangles[i].err[3]>errorBound) continue;
+			work.push_back(i);
+			queued[i]=1;
+		}
+		int pops=0;
+		while(!work.empty())
+		{
+			if((++pops&4095)==0 && out_of_time()) break;
+			int tid=work.back();
+			work.pop_back();
+			queued[tid]=0;
+			Triangle &t=triangles[tid];
+			if(t.deleted) continue;
+			loopj(0,3)if(t.err[j]<=errorBound)
+			{
+				int i0=t.v[j];
+				if(!collapse_edge<UniformThreshold, Textured>(t,j,deleted_triangles,deleted0,deleted1)) continue;
+				const Vertex &v=vertices[i0];
+				loopk(0,v.tcount)
+				{
+					int r=refs[v.tstart+k].tid;
+					const Triangle &n=triangles[r];
+					if(n.deleted || queued[r] || n.err[3]>errorBound) continue;
+					work.push_back(r);
+					queued[r]=1;
+				}
+				break;
+			}
+		}
+		free_vector(losslessWork);
+		free_vector(losslessQueued);
+	}
+
+	// Picks the collapse_pass instance for the current mode, once per pass
+	template<bool Textured>
+	bool dispatch_pass(bool lockRegion, double threshold0, int triangle_count, int target_count, int &deleted_triangles,
+		std::vector<int> &deleted0, std::vector<int> &deleted1)
+	{
+		if (lockRegion) {
+			if (factorMode) return collapse_pass<RegionLockedThreshold<FactorThreshold>, Textured>(threshold0, triangle_count, target_count, deleted_triangles, deleted0, deleted1);
+			return collapse_pass<RegionLockedThreshold<UniformThreshold>, Textured>(threshold0, triangle_count, target_count, deleted_triangles, deleted0, deleted1);
+		}
+		if (factorMode) return collapse_pass<FactorThreshold, Textured>(threshold0, triangle_count, target_count, deleted_triangles, deleted0, deleted1);
+		return collapse_pass<UniformThreshold, Textured>(threshold0, triangle_count, target_count, deleted_triangles, deleted0, deleted1);
+	}
+
+	void set_deadline_ms(double ms)
+	{
+		hasDeadline = ms > 0;
+		deadline = std::chrono::steady_clock::now() + std::chrono::microseconds((long long)(ms*1000));
+	}
+
+	double bounding_diagonal()
+	{
+		if(vertices.empty()) return 0;
+		vec3<double> lo=vertices[0].p, hi=lo;
+		loopi(1,vertices.size())
+		{
+			const vec3f &p=vertices[i].p;
+			lo.x=std::min(lo.x,double(p.x)); lo.y=std::min(lo.y,double(p.y)); lo.z=std::min(lo.z,double(p.z));
+			hi.x=std::max(hi.x,double(p.x)); hi.y=std::max(hi.y,double(p.y)); hi.z=std::max(hi.z,double(p.z));
+		}
+		return (hi-lo).length();
+	}
+
+	// Error below which about a fraction q of the live triangles lie, from a
+	// strided sample. With a per-vertex factor the errors are divided by it,
+	// as collapse_pass multiplies the threshold by it.
+	double error_quantile(double q)
+	{
+		errorSample.clear();
+		int stride = std::max(1, int(triangles.size()/ERROR_SAMPLE));
+		for (int i = 0; i < int(triangles.size()); i += stride)
+		{
+			const Triangle &t = triangles[i];
+			if (t.deleted) continue;
+			double e = t.err[3];
+			if (factorMode && vertexFactor[t.v[0]] > 0) e /= vertexFactor[t.v[0]];
+			errorSample.push_back(e);
+		}
+		if (errorSample.empty()) return 0;
+		int k = std::min(int(q*errorSample.size()), int(errorSample.size())-1);
+		std::nth_element(errorSample.begin(), errorSample.begin()+k, errorSample.end());
+		// collapse_pass takes errors strictly below the threshold
+		return nextafter(errorSample[k], DBL_MAX);
+	}
+
+	// A collapse keeps the mesh manifold if the ends of the edge have no
+	// common neighbour but the apexes of its triangles; an edge between two
+	// border vertices must also be open, or it would cut the boundary short
+	bool link_condition(int i0, int i1, bool border)
+	{
+		std::vector<int> &n=linkScratch;
+		n.clear();
+		int shared=0;
+		const Vertex &v0=vertices[i0];
+		loopk(0,v0.tcount)
+		{
+			const Ref &r=refs[v0.tstart+k];
+			const Triangle &t=triangles[r.tid];
+			if(t.deleted) continue;
+			int a=t.v[(r.tvertex+1)%3], b=t.v[(r.tvertex+2)%3];
+			if(a==i1 || b==i1) shared++;
+			n.push_back(a); n.push_back(b);
+		}
+		if(border && shared!=1) return false;
+		std::sort(n.begin(), n.end());
+		n.erase(std::unique(n.begin(), n.end()), n.end());
+		int common=0;
+		const Vertex &v1=vertices[i1];
+		size_t end=n.size();
+		loopk(0,v1.tcount)
+		{
+			const Ref &r=refs[v1.tstart+k];
+			const Triangle &t=triangles[r.tid];
+			if(t.deleted) continue;
+			loopj(1,3)
+			{
+				int c=t.v[(r.tvertex+j)%3];
+				if(c==i0 || !std::binary_search(n.begin(), n.begin()+end, c)) continue;
+				n.push_back(c); // counted once, below
+			}
+		}
+		std::sort(n.begin()+end, n.end());
+		common=std::unique(n.begin()+end, n.end())-(n.begin()+end);
+		return common<=shared;
+	}
+
+	bool out_of_time()
+	{
+		if(simplifyStopRequested || (hasDeadline && std::chrono::steady_clock::now() >= deadline)) stoppedEarly = true;
+		return stoppedEarly;
+	}
+
 	//
 	// Main simplification function
 	//
@@ -490,6 +1202,18 @@ namespace Simplify
         {
             triangles[i].deleted=0;
         }
+		stoppedEarly = false;
+		flipNormalDot = 0.2;
+		flipParallel = 0.999;
+		int stalledPasses = 0, lastRejected = 0;
+		bool flipRelaxed = false;
+		collapseCount = 0;
+		collapseErrorMax = collapseErrorSum = 0;
+		errorBound = DBL_MAX;
+		if (maxError > 0) {
+			double bound = maxError*bounding_diagonal();
+			errorBound = bound*bound;
+		}
 
 		// main iteration loop
 		int deleted_triangles=0;
@@ -499,14 +1223,33 @@ namespace Simplify
 		int triangle_count=triangles.size();
 		int consecutiveNoDeletion = 0;
 		double threshold0;
-		double threshold;
+		double adaptiveBoost = 1; // doubled after each pass that removes nothing
+		// with the heap finish the passes only go down to passTarget; the margin
+		// is clamped before the cast, as a large -F would overflow int
+		bool heapFinish = heapMargin > 0 && target_count > 0 && !doRegionSimplification && !doMultipleCenters;
+		int passTarget = heapFinish ? target_count + int(std::min<double>(heapMargin*target_count, triangle_count)) : target_count;
+		stopPassAtTarget = heapFinish;
+		bool textured = false;
+		loopi(0,triangles.size()) if ((triangles[i].attr & TEXCOORD) == TEXCOORD) { textured = true; break; }
+		if (doMultipleCenters) {
+			factorMode = anyRegionsBound ? FACTOR_REGIONS_BOUND : FACTOR_ALL_CENTERS;
+		} else if (func != constantFunc) {
+			factorMode = FACTOR_SINGLE;
+			Region f = {1.0, false, func, vec3<double>(coord[0], coord[1], coord[2]), radius, scale, power, isneg, false, 0, 0};
+			init_region_falloff(f);
+			factorFunc = f;
+		} else {
+			factorMode = FACTOR_NONE;
+		}
 		if (doRegionSimplification && !doMultipleCenters) {
 			regions.clear();
 			Region singleRegion = {target_region_ratio, false, func, 
-			vec3f(coord[0], coord[1], coord[2]), radius, scale, power, isneg,
+			vec3<double>(coord[0], coord[1], coord[2]), radius, scale, power, isneg,
 			regionDone, initialTotalCount, 0};
+			init_region_falloff(singleRegion);
 			regions.push_back(singleRegion);
-			currentRegionCount = currentCountInRegion(regions[0]);
+			init_region_counters();
+			currentRegionCount = regions[0].endCount;
 			currentRegionRatio = double(currentRegionCount)/double(initialRegionCount);
 			if (currentRegionRatio <= target_region_ratio) {
 				// printf("Inside Region Ratio: %f\n", currentRegionRatio);
@@ -515,11 +1258,12 @@ namespace Simplify
 		} else if (doMultipleCenters) {
 			doRegionSimplification = false;
 			// regions will have been assigned in main
+			init_region_counters();
 			loopi(0, int(regions.size())) {
-				regions[i].endCount = currentCountInRegion(regions[i]);
 				regions[i].startCount = regions[i].endCount;
 			}
 		}
+		init_vertex_factors();
 		//int iteration = 0;
 		//loop(iteration,0,100)
 		//double initial_agressiveness = agressiveness;
@@ -528,12 +1272,15 @@ namespace Simplify
 		for (int iteration = 0; iteration < triangle_count; iteration ++)
 		{
 			deleted_triangles_before = deleted_triangles;
-			if(triangle_count-deleted_triangles<=target_count)break;
+			if(triangle_count-deleted_triangles<=passTarget)break;
+			if(out_of_time())
+			{
+				if(verbose) printf("Stopping early at iteration %d: %s\n", iteration, simplifyStopRequested ? "stop requested" : "deadline reached");
+				break;
+			}
 			currentRegionCount = 0;
 			if (doRegionSimplification) {
-				for (int i = 0; i < (int)(triangles.size()); i++) {
-            		if (inRegion(triangles[i], coord, radius)) currentRegionCount++;
-        		}
+				currentRegionCount = regions[0].endCount;
 				currentRegionRatio = double(currentRegionCount)/double(initialRegionCount);
 				if(currentRegionRatio <= target_region_ratio) {
 					// printf("Inside Region Ratio: %f\n", currentRegionRatio);
@@ -542,7 +1289,7 @@ namespace Simplify
 			}
 			//if(regionDone) agressiveness=initial_agressiveness + 3;
 			// update mesh once in a while
-			if(iteration%5==0)
+			if(iteration==0 || rebuild_due(triangle_count-deleted_triangles))
 			{
 				update_mesh(iteration);
 			}
@@ -556,125 +1303,35 @@ namespace Simplify
 			// The following numbers works well for most models.
 			// If it does not, try to adjust the 3 parameters
 			//
-			threshold0 = 0.000000001*pow(double(iteration+3),agressiveness);
+			if (adaptiveFraction > 0) {
+				int live = triangle_count-deleted_triangles;
+				double q = adaptiveFraction*adaptiveBoost*(live-std::max(passTarget,0))/live;
+				threshold0 = error_quantile(std::min(q, 1.0));
+			}
+			else threshold0 = 0.000000001*pow(double(iteration+3),agressiveness);
+			bool atBound = threshold0 >= errorBound;
+			if (atBound) threshold0 = errorBound;
 			// target number of triangles reached ? Then break
 			if ((verbose) && (iteration%5==0)) {
-				printf("iteration %*d - total triangles %*d, iter's threshold = (iter+3)^aggr*e-09 = %g\n",printwidth, iteration, printwidth, triangle_count-deleted_triangles, threshold0);
+				if (adaptiveFraction > 0) printf("iteration %*d - total triangles %*d, iter's threshold = error quantile = %g\n",printwidth, iteration, printwidth, triangle_count-deleted_triangles, threshold0);
+				else printf("iteration %*d - total triangles %*d, iter's threshold = (iter+3)^aggr*e-09 = %g\n",printwidth, iteration, printwidth, triangle_count-deleted_triangles, threshold0);
 				// printf(" triangle.size(): %f\n", double(triangles.size()));
 				// printf(" Count: %lli, Region inside radius reduced to %f\n", currentRegionCount, double(currentRegionCount)/double(initialRegionCount));
 			}
-			bool breakIteration = false;
-			// remove vertices & mark deleted triangles
-			loopi(0,triangles.size())
-			{
-				Triangle &t=triangles[i];
-				if(t.deleted) continue;
-				if(t.dirty) continue;
-				//bool multipleCentersDone = true;
-				
-				if (doMultipleCenters) {
-					// 
-					// Doing Multiple Bound/Unbound Centers (option -L)
-					// 
-					if (anyRegionsBound) { // Fix here
-						threshold = thresholdRegionsBound(t, threshold0);
-					} else {
-						threshold = thresholdAllCenters(t, threshold0);
-					}
-				} else if (doRegionSimplification && regionDone) {
-					// 
-					// Doing Single Bound Region (option -T)
-					// 
-					if(inRegion(t, coord, radius)) {
-						threshold = 0;
-					} else {
-					double squareFactor = square(vertices[t.v[0]].p.x, vertices[t.v[0]].p.y, vertices[t.v[0]].p.z,
-					coord[0], coord[1], coord[2], radius, 1.0, false);
-					if (func != constantFunc) {
-						if ((fabs(squareFactor - 0)) <= 0.000000001) {
-							threshold = 0;
-						} else {
-							threshold = threshold0*pow(func(
-							vertices[t.v[0]].p.x, vertices[t.v[0]].p.y, vertices[t.v[0]].p.z,
-							coord[0], coord[1], coord[2],
-							radius, scale, isneg), power)*squareFactor;
-						}
-					} else {
-						threshold = threshold0*squareFactor;
-					}
-					}
-				} else {
-					// 
-					// Doing Whole Mesh (default option)
-					// 
-					if (func != constantFunc) {
-						threshold = threshold0*pow(func(
-						vertices[t.v[0]].p.x, vertices[t.v[0]].p.y, vertices[t.v[0]].p.z,
-						coord[0], coord[1], coord[2],
-						radius, scale, isneg), power);
-					} else {
-						threshold = threshold0;
-					}
-					//printf("vertices.size() = %d, triangles.size() = %d\n", int(vertices.size()), int(triangles.size()));
-				}
-				
-				
-				if(t.err[3]>threshold) continue;
-
-				loopj(0,3)if(t.err[j]<threshold)
-				{
-
-					int i0=t.v[ j     ]; Vertex &v0 = vertices[i0];
-					int i1=t.v[(j+1)%3]; Vertex &v1 = vertices[i1];
-					// Border check
-					if(v0.border != v1.border)  continue;
-
-					// Compute vertex to collapse to
-					vec3f p;
-					calculate_error(i0,i1,p);
-					deleted0.resize(v0.tcount); // normals temporarily
-					deleted1.resize(v1.tcount); // normals temporarily
-					// don't remove if flipped
-					if( flipped(p,i0,i1,v0,v1,deleted0) ) continue;
-
-					if( flipped(p,i1,i0,v1,v0,deleted1) ) continue;
-
-					if ( (t.attr & TEXCOORD) == TEXCOORD  )
-					{
-						update_uvs(i0,v0,p,deleted0);
-						update_uvs(i0,v1,p,deleted1);
-					}
-
-					// not flipped, so remove edge
-					v0.p=p;
-					v0.q=v1.q+v0.q;
-					int tstart=refs.size();
-
-					update_triangles(i0,v0,deleted0,deleted_triangles);
-					update_triangles(i0,v1,deleted1,deleted_triangles);
-
-					int tcount=refs.size()-tstart;
-
-					if(tcount<=v0.tcount)
-					{
-						// save ram
-						if(tcount)memcpy(&refs[v0.tstart],&refs[tstart],tcount*sizeof(Ref));
-					}
-					else
-						// append
-						v0.tstart=tstart;
-
-					v0.tcount=tcount;
-					break;
-				}
-				// done?
-				//if(triangle_count-deleted_triangles<=target_count) break;
-				if(!breakIteration && (triangle_count-deleted_triangles<=target_count)) breakIteration = true; // may delete entire mesh
-			}
+			bool lockRegion = doRegionSimplification && regionDone;
+			rejectBorder = rejectFlip = rejectBound = 0;
+			bool breakIteration = textured ?
+				dispatch_pass<true>(lockRegion, threshold0, triangle_count, passTarget, deleted_triangles, deleted0, deleted1) :
+				dispatch_pass<false>(lockRegion, threshold0, triangle_count, passTarget, deleted_triangles, deleted0, deleted1);
 			// 
 			// Here is at the end of iteration
 			// 
 			deleted_triangles_after = deleted_triangles;
+			if(atBound && deleted_triangles_before == deleted_triangles_after && !stoppedEarly) {
+				if(verbose) printf("Error bound reached at iteration %d\n", iteration);
+				break;
+			}
+			adaptiveBoost = (deleted_triangles_before == deleted_triangles_after) ? adaptiveBoost*2 : 1;
 			if(deleted_triangles_before == deleted_triangles_after) {
 				consecutiveNoDeletion++;
 				if(verbose && (iteration%5==0)) printf("No triangles deleted yet.\n");
@@ -683,15 +1340,50 @@ namespace Simplify
 					break;
 				}
 			}
+			int rejected = rejectBorder+rejectFlip+rejectBound;
+			bool stalled = false;
+			if(deleted_triangles_before != deleted_triangles_after || stoppedEarly) {
+				stalledPasses = lastRejected = 0;
+			}
+			else if(adaptiveFraction == 0 && !atBound) {
+				// A pass that deletes nothing changes nothing, so the passes up to
+				// the first threshold above the next edge error can be skipped
+				double e = passNextError;
+				if(e == DBL_MAX) stalled = rejected > 0; // every edge tried and rejected
+				else {
+					int next = iteration+1;
+					while(next < triangle_count && 0.000000001*pow(double(next+3),agressiveness) <= e) next++;
+					if(next-1 > iteration) {
+						if(verbose) printf("Stall at iteration %d: no new edge below threshold %g, skipping to iteration %d\n", iteration, threshold0, next);
+						consecutiveNoDeletion += next-1-iteration;
+						if(consecutiveNoDeletion >= consecutiveNoDeletionThreshold) break;
+						iteration = next-1;
+					}
+				}
+			}
+			else if(rejected > lastRejected) {
+				stalledPasses = 0; // the threshold still brings new candidates
+				lastRejected = rejected;
+			}
+			else stalled = ++stalledPasses >= stallPasses;
+			if(stalled) {
+				stalledPasses = 0;
+				if(rejectFlip > 0 && !flipRelaxed) {
+					flipRelaxed = true;
+					flipNormalDot = 0.0;
+					flipParallel = 0.9999;
+					std::fill(flipMemo.begin(), flipMemo.end(), 0);
+					if(verbose) printf("Stall at iteration %d: rejected %d border, %d flip, %d bound; relaxing flip limits\n", iteration, rejectBorder, rejectFlip, rejectBound);
+				} else {
+					if(verbose) printf("Stall at iteration %d: rejected %d border, %d flip, %d bound; stopping with %d triangles\n", iteration, rejectBorder, rejectFlip, rejectBound, triangle_count-deleted_triangles);
+					break;
+				}
+			}
 			if(doRegionSimplification && regionDone) {
-				//currentRegionCount = currentCountInRegion(regions[0]);
-				currentRegionCount = 0;
-				for (int i = 0; i < (int)(triangles.size()); i++) {
-            		if (inRegion(triangles[i], coord, radius)) currentRegionCount++;
-        		}
+				currentRegionCount = regions[0].endCount;
 				currentRegionRatio = double(currentRegionCount)/double(initialRegionCount);
 				int initialOutsideCount = initialTotalCount - initialRegionCount;
-				int currentOutsideCount = (int)(triangles.size()) - currentRegionCount;
+				int currentOutsideCount = triangle_count - deleted_triangles - currentRegionCount;
 				currentOutsideRatio = double(currentOutsideCount)/double(initialOutsideCount);
 				if (currentOutsideRatio <= target_outside_ratio) break;
 			} else if (doMultipleCenters) {
@@ -706,109 +1398,193 @@ namespace Simplify
 			}
 			if(breakIteration) break;
 		}
+		if(heapFinish && !stoppedEarly && triangle_count-deleted_triangles>target_count)
+		{
+			if(verbose) printf("Heap finish from %d triangles to %d\n", triangle_count-deleted_triangles, target_count);
+			if(textured) {
+				if(factorMode) heap_finish<FactorThreshold, true>(triangle_count, target_count, deleted_triangles, deleted0, deleted1);
+				else heap_finish<UniformThreshold, true>(triangle_count, target_count, deleted_triangles, deleted0, deleted1);
+			} else {
+				if(factorMode) heap_finish<FactorThreshold, false>(triangle_count, target_count, deleted_triangles, deleted0, deleted1);
+				else heap_finish<UniformThreshold, false>(triangle_count, target_count, deleted_triangles, deleted0, deleted1);
+			}
+		}
+		stopPassAtTarget = false;
+		flipNormalDot = 0.2;
+		flipParallel = 0.999;
 		// clean up mesh
 		// if (doRegionSimplification && regionDone) printf("Inside Region Reduction: %.8lf (%d triangles), Outside Region Reduction: %.8lf (%d triangles)\n",
 		// 		 currentRegionRatio, currentRegionCount, currentOutsideRatio, (int)(triangles.size()) - currentRegionCount);
 		// printf("Final tri count: %lli, Region inside radius reduced to %f\n", currentRegionCount, double(currentRegionCount)/double(initialRegionCount));
+		regionWords = 0; // vertex ids change in compact_mesh
+		regionBits.clear();
+		factorMode = FACTOR_NONE;
+		vertexFactor.clear();
 		compact_mesh();
+		// scratch is only needed while simplifying
+		free_vector(triangleScratch);
+		free_vector(refScratch);
+		free_vector(triangleRemap);
+		free_vector(vertexRemap);
+		loopi(0,REF_CLASSES) free_vector(refFree[i]);
+		free_vector(flipMemo);
+		free_vector(ringClock);
 	} //simplify_mesh()
 
-	void simplify_mesh_lossless(bool verbose=false)
-	{
-		// init
-		loopi(0,triangles.size()) triangles[i].deleted=0;
+	//
+	// Region-only simplification (-T <ratio>,1.0)
+	//
+	// The triangles inside the sphere are moved into a compact submesh whose
+	// vertices shared with the rest of the mesh come first and are locked, so
+	// the submesh is simplified alone and spliced back without touching the
+	// outside. Returns false, leaving the mesh unchanged, if there is nothing
+	// to simplify or the locked ring did not survive.
+	//
 
-		// main iteration loop
-		int deleted_triangles=0;
-		std::vector<int> deleted0,deleted1;
-		//int triangle_count=triangles.size(); // unused variable in function
-		//int iteration = 0;
-		//loop(iteration,0,100)
-		for (int iteration = 0; iteration < 9999; iteration ++)
+	bool simplify_region_only(double coord[3], double region_ratio, double agressiveness=7, bool verbose=false,
+		double (*func)(double, double, double, double, double, double, double, double, bool)=constantFunc,
+		double radius=def_radius, double scale=def_scale, double power=1, bool isneg=false)
+	{
+		int nv=vertices.size(), nt=triangles.size();
+		// 0: unused by the region, 1: region only, 2: region and outside
+		std::vector<char> use(nv, 0);
+		std::vector<char> inside(nt, 0);
+		int regionCount=0;
+		loopi(0,nt) if(inRegion(triangles[i], coord, radius))
 		{
-			// update mesh constantly
-			update_mesh(iteration);
-			// clear dirty flag
-			loopi(0,triangles.size()) triangles[i].dirty=0;
-			//
-			// All triangles with edges below the threshold will be removed
-			//
-			// The following numbers works well for most models.
-			// If it does not, try to adjust the 3 parameters
-			//
-			double threshold = DBL_EPSILON; //1.0E-3 EPS;
-			if (verbose) {
-				printf("lossless iteration %d\n", iteration);
-			}
-
-			// remove vertices & mark deleted triangles
-			loopi(0,triangles.size())
-			{
-				Triangle &t=triangles[i];
-				if(t.err[3]>threshold) continue;
-				if(t.deleted) continue;
-				if(t.dirty) continue;
-
-				loopj(0,3)if(t.err[j]<threshold)
-				{
-					int i0=t.v[ j     ]; Vertex &v0 = vertices[i0];
-					int i1=t.v[(j+1)%3]; Vertex &v1 = vertices[i1];
-
-					// Border check
-					if(v0.border != v1.border)  continue;
-
-					// Compute vertex to collapse to
-					vec3f p;
-					calculate_error(i0,i1,p);
-
-					deleted0.resize(v0.tcount); // normals temporarily
-					deleted1.resize(v1.tcount); // normals temporarily
-
-					// don't remove if flipped
-					if( flipped(p,i0,i1,v0,v1,deleted0) ) continue;
-					if( flipped(p,i1,i0,v1,v0,deleted1) ) continue;
+			inside[i]=1;
+			regionCount++;
+			loopj(0,3) use[triangles[i].v[j]]=1;
+		}
+		int target_count = round(double(regionCount)*region_ratio);
+		if(regionCount==0 || target_count>=regionCount) return false;
+		loopi(0,nt) if(!inside[i]) loopj(0,3)
+		{
+			char &u=use[triangles[i].v[j]];
+			if(u) u=2;
+		}
 
-					if ( (t.attr & TEXCOORD) == TEXCOORD )
-					{
-						update_uvs(i0,v0,p,deleted0);
-						update_uvs(i0,v1,p,deleted1);
-					}
+		// Submesh: ring vertices first, then the interior
+		std::vector<int> local(nv, -1), global;
+		loopi(0,nv) if(use[i]==2) { local[i]=global.size(); global.push_back(i); }
+		int ring=global.size();
+		loopi(0,nv) if(use[i]==1) { local[i]=global.size(); global.push_back(i); }
+		std::vector<Vertex> full, sub(global.size());
+		std::vector<Triangle> outside, subtris;
+		outside.reserve(nt-regionCount);
+		subtris.reserve(regionCount);
+		loopi(0,global.size()) sub[i]=vertices[global[i]];
+		loopi(0,nt)
+		{
+			Triangle &t=triangles[i];
+			if(!inside[i]) { outside.push_back(t); continue; }
+			subtris.push_back(t);
+			loopj(0,3) subtris.back().v[j]=local[t.v[j]];
+		}
+		full.swap(vertices);
+		vertices.swap(sub);
+		triangles.swap(subtris);
+
+		if(verbose) printf("Region submesh: %d triangles, %d vertices (%d locked)\n", regionCount, int(global.size()), ring);
+		lockedVertexCount=ring;
+		simplify_mesh(coord, target_count, agressiveness, verbose, func, radius, scale, power, isneg);
+		lockedVertexCount=0;
+
+		// compact_mesh keeps vertex order and locked vertices never move
+		bool ringKept = int(vertices.size())>=ring;
+		loopi(0,ring) if(!ringKept || !(vertices[i].p==full[global[i]].p)) { ringKept=false; break; }
+		vertices.swap(full);
+		triangles.swap(subtris);
+		if(!ringKept)
+		{
+			printf("WARNING: Region boundary changed, mesh left unchanged\n");
+			return false;
+		}
 
-					// not flipped, so remove edge
-					v0.p=p;
-					v0.q=v1.q+v0.q;
-					int tstart=refs.size();
+		// Splice: outside triangles keep their ids, new interior vertices are appended
+		int base=vertices.size();
+		loopi(ring,full.size()) vertices.push_back(full[i]);
+		triangles.swap(outside);
+		triangles.reserve(triangles.size()+subtris.size());
+		loopi(0,subtris.size())
+		{
+			Triangle t=subtris[i];
+			loopj(0,3) t.v[j] = t.v[j]<ring ? global[t.v[j]] : base+t.v[j]-ring;
+			triangles.push_back(t);
+		}
+		loopi(0,triangles.size()) triangles[i].deleted=0;
+		compact_mesh(); // drops the replaced interior vertices
 
-					update_triangles(i0,v0,deleted0,deleted_triangles);
-					update_triangles(i0,v1,deleted1,deleted_triangles);
+		int regionTriangles=subtris.size();
+		initialRegionCount=regionCount;
+		currentRegionCount=regionTriangles;
+		currentRegionRatio=double(regionTriangles)/double(regionCount);
+		currentOutsideRatio=1;
+		regionDone=true;
+		return true;
+	} //simplify_region_only()
 
-					int tcount=refs.size()-tstart;
+	//
+	// Lossless simplification (-l)
+	//
+	// Removes only what costs nothing: edges whose error is below
+	// (losslessTolerance*diagonal)^2, such as those inside flat or straight
+	// regions. The refs are built once and lossless_worklist works through
+	// the candidates incrementally, so there are no passes and no rebuilds.
+	//
+	void simplify_mesh_lossless(bool verbose=false)
+	{
+		// init
+		loopi(0,triangles.size()) triangles[i].deleted=0;
+		stoppedEarly = false;
+		flipNormalDot = 0.2;
+		flipParallel = 0.999;
+		collapseCount = 0;
+		collapseErrorMax = collapseErrorSum = 0;
+		rejectBorder = rejectFlip = rejectBound = 0;
+		double tolerance = losslessTolerance*bounding_diagonal();
+		errorBound = tolerance*tolerance;
+		bool textured = false;
+		loopi(0,triangles.size()) if ((triangles[i].attr & TEXCOORD) == TEXCOORD) { textured = true; break; }
+		factorMode = FACTOR_NONE;
+		keepEndpoints = true;
+		// without boundary planes an open corner could slide along the border
+		// at no cost
+		double weight = borderWeight;
+#ifndef SIMPLIFY_MEMORYLESS
+		if(!(borderWeight > 0)) borderWeight = 1;
+#endif
+		update_mesh(0);
 
-					if(tcount<=v0.tcount)
-					{
-						// save ram
-						if(tcount)memcpy(&refs[v0.tstart],&refs[tstart],tcount*sizeof(Ref));
-					}
-					else
-						// append
-						v0.tstart=tstart;
+		int deleted_triangles=0;
+		std::vector<int> deleted0,deleted1;
+		if(textured) lossless_worklist<true>(deleted_triangles, deleted0, deleted1);
+		else lossless_worklist<false>(deleted_triangles, deleted0, deleted1);
+		if(verbose) printf("Lossless: %d collapses below %g, %d triangles removed; rejected %d border, %d flip\n",
+			collapseCount, errorBound, deleted_triangles, rejectBorder, rejectFlip);
+		errorBound = DBL_MAX;
+		keepEndpoints = false;
+		borderWeight = weight;
 
-					v0.tcount=tcount;
-					break;
-				}
-			}
-			if(deleted_triangles<=0)break;
-			deleted_triangles=0;
-		} //for each iteration
 		// clean up mesh
 		compact_mesh();
+		free_vector(triangleScratch);
+		free_vector(refScratch);
+		free_vector(triangleRemap);
+		free_vector(vertexRemap);
+		loopi(0,REF_CLASSES) free_vector(refFree[i]);
+		free_vector(flipMemo);
+		free_vector(ringClock);
 	} //simplify_mesh_lossless()
 
-	// Check if a triangle flips when this edge is removed
+	// Check if a triangle flips when this edge is removed. The triangles that
+	// stay are gathered FLIP_BLOCK at a time and tested together (flipped_n).
 
 	bool flipped(vec3f p,int i0,int i1,Vertex &v0,Vertex &v1,std::vector<int> &deleted)
 	{
-
+		FlipBlock<Real> f;
+		Real dot=flipNormalDot, parallel=flipParallel;
+		int n=0;
 		loopk(0,v0.tcount)
 		{
 			Triangle &t=triangles[refs[v0.tstart+k].tid];
@@ -824,16 +1600,16 @@ namespace Simplify
 				deleted[k]=1;
 				continue;
 			}
-			vec3f d1 = vertices[id1].p-p; d1.normalize();
-			vec3f d2 = vertices[id2].p-p; d2.normalize();
-			if(fabs(d1.dot(d2))>0.999) return true;
-			vec3f n;
-			n.cross(d1,d2);
-			n.normalize();
 			deleted[k]=0;
-			if(n.dot(t.n)<0.2) return true;
+			const vec3f &a=vertices[id1].p, &b=vertices[id2].p;
+			f.ax[n]=a.x; f.ay[n]=a.y; f.az[n]=a.z;
+			f.bx[n]=b.x; f.by[n]=b.y; f.bz[n]=b.z;
+			f.nx[n]=t.n.x; f.ny[n]=t.n.y; f.nz[n]=t.n.z;
+			if(++n<FLIP_BLOCK) continue;
+			if(flipped_n(f, n, p.x, p.y, p.z, dot, parallel)) return true;
+			n=0;
 		}
-		return false;
+		return n>0 && flipped_n(f, n, p.x, p.y, p.z, dot, parallel);
 	}
 
     // update_uvs
@@ -853,16 +1629,78 @@ namespace Simplify
 		}
 	}
 
+	// Moves the new ring of v0, built at the end of refs from tstart, into
+	// v0's own slot or a free one, and releases the slots it no longer needs.
+	// The end of refs is then trimmed back, so refs only grows when no slot fits.
+
+	void store_refs(Vertex &v0, Vertex &v1, int tstart, int tcount)
+	{
+		int dst=-1;
+		if(tcount<=v0.tcount) dst=v0.tstart;
+		else if(v0.tstart+v0.tcount==v1.tstart && tcount<=v0.tcount+v1.tcount) dst=v0.tstart;
+		else if(v1.tstart+v1.tcount==v0.tstart && tcount<=v0.tcount+v1.tcount) dst=v1.tstart;
+		if(dst>=0)
+		{
+			// v0's slot, possibly joined with the adjacent one of v1
+			if(dst==v0.tstart && tcount<=v0.tcount) free_refs(v1.tstart, v1.tcount);
+		}
+		else
+		{
+			int c=0;
+			while(c+1<REF_CLASSES && (2<<c)<=tcount) c++;
+			for(; c<REF_CLASSES && dst<0; c++)
+			{
+				std::vector<RefSlot> &f=refFree[c];
+				if(f.empty() || f.back().size<tcount) continue;
+				RefSlot slot=f.back();
+				f.pop_back(); // before the rest goes back, maybe onto this list
+				dst=slot.tstart;
+				free_refs(dst+tcount, slot.size-tcount);
+			}
+			free_refs(v0.tstart, v0.tcount);
+			free_refs(v1.tstart, v1.tcount);
+		}
+		v1.tcount=0; // v1 has no triangles left
+		if(dst>=0)
+		{
+			if(tcount)memcpy(&refs[dst],&refs[tstart],tcount*sizeof(Ref));
+			refs.resize(tstart);
+			v0.tstart=dst;
+		}
+		else v0.tstart=tstart;
+		v0.tcount=tcount;
+	}
+
+	void free_refs(int tstart, int size)
+	{
+		if(size<=0) return;
+		int c=0;
+		while(c+1<REF_CLASSES && (2<<c)<=size) c++;
+		RefSlot slot={tstart,size};
+		refFree[c].push_back(slot);
+	}
+
+	// Rebuild refs and compact triangles once a quarter of the triangle list is
+	// deleted, or once refs holds more than twice the refs of live triangles
+
+	bool rebuild_due(int live_triangles)
+	{
+		return live_triangles*4 < int(triangles.size())*3 || refs.size() > size_t(live_triangles)*6;
+	}
+
 	// Update triangle connections and edge error after a edge is collapsed
 
 	void update_triangles(int i0,Vertex &v,std::vector<int> &deleted,int &deleted_triangles)
 	{
-		vec3f p;
+		// new membership of i0; regionBits[i0] keeps the old one until the collapse is done
+		if(regionWords) region_bits(vertices[i0].p, &regionScratch[0]);
 		loopk(0,v.tcount)
 		{
 			Ref &r=refs[v.tstart+k];
 			Triangle &t=triangles[r.tid];
 			if(t.deleted)continue;
+			loopj(0,3) ringClock[t.v[j]]=flipClock;
+			if(regionWords) count_region_triangle(t, -1);
 			if(deleted[k])
 			{
 				t.deleted=1;
@@ -870,12 +1708,26 @@ namespace Simplify
 				continue;
 			}
 			t.v[r.tvertex]=i0;
+			if(regionWords) count_region_triangle(t, 1, i0, &regionScratch[0]);
 			t.dirty=1;
+			refs.push_back(r);
+		}
+	}
+
+	// Edge errors of the triangles around i0 once its refs are stored, so that
+	// calculate_error sees the finished collapse
+
+	void update_errors(int i0)
+	{
+		vec3f p;
+		const Vertex &v=vertices[i0];
+		loopk(0,v.tcount)
+		{
+			Triangle &t=triangles[refs[v.tstart+k].tid];
 			t.err[0]=calculate_error(t.v[0],t.v[1],p);
 			t.err[1]=calculate_error(t.v[1],t.v[2],p);
 			t.err[2]=calculate_error(t.v[2],t.v[0],p);
 			t.err[3]=min(t.err[0],min(t.err[1],t.err[2]));
-			refs.push_back(r);
 		}
 	}
 
@@ -883,16 +1735,132 @@ namespace Simplify
 
 	void update_mesh(int iteration)
 	{
-		if(iteration>0) // compact triangles
+		loopi(0,REF_CLASSES) refFree[i].clear();
+		if(iteration>0)
 		{
-			int dst=0;
-			loopi(0,triangles.size())
-			if(!triangles[i].deleted)
+			// compact triangles
+			compact_triangles();
+			flipMemo.assign(triangles.size()*3, 0);
+			ringClock.assign(vertices.size(), 0);
+
+			// Rebuild each vertex's refs from its previous list: keep the live
+			// triangles that still hold the vertex, renumbered and in triangle
+			// order as the full build below would give them.
+			int nv=vertices.size();
+			vertexRemap.resize(nv+1);
+			OMP(omp parallel for schedule(static))
+			for (int i = 0; i < nv; i++)
+			{
+				const Vertex &v=vertices[i];
+				int count=0;
+				loopj(0,v.tcount)
+				{
+					const Ref &r=refs[v.tstart+j];
+					int tid=triangleRemap[r.tid];
+					if(tid>=0 && triangles[tid].v[r.tvertex]==i) count++;
+				}
+				vertexRemap[i]=count;
+			}
+			refScratch.resize(exclusive_scan(&vertexRemap[0], nv));
+			OMP(omp parallel for schedule(static))
+			for (int i = 0; i < nv; i++)
+			{
+				Vertex &v=vertices[i];
+				Ref *dst=refScratch.empty() ? NULL : &refScratch[vertexRemap[i]];
+				int count=0;
+				loopj(0,v.tcount)
+				{
+					Ref r=refs[v.tstart+j];
+					r.tid=triangleRemap[r.tid];
+					if(r.tid<0 || triangles[r.tid].v[r.tvertex]!=i) continue;
+					dst[count++]=r;
+				}
+				// mostly in order already; collapses append out of order
+				if(!std::is_sorted(dst, dst+count)) std::sort(dst, dst+count);
+				v.tstart=vertexRemap[i];
+				v.tcount=count;
+			}
+			refs.swap(refScratch);
+			return;
+		}
+
+		flipMemo.assign(triangles.size()*3, 0);
+		ringClock.assign(vertices.size(), 0);
+
+		// Init Reference ID list
+		loopi(0,vertices.size())
+		{
+			vertices[i].tstart=0;
+			vertices[i].tcount=0;
+		}
+		loopi(0,triangles.size())
+		{
+			Triangle &t=triangles[i];
+			loopj(0,3) vertices[t.v[j]].tcount++;
+		}
+		int tstart=0;
+		loopi(0,vertices.size())
+		{
+			Vertex &v=vertices[i];
+			v.tstart=tstart;
+			tstart+=v.tcount;
+			v.tcount=0;
+		}
+
+		// Write References
+		refs.reserve(triangles.size()*3);
+		advise_huge_pages(refs);
+		refs.resize(triangles.size()*3);
+		loopi(0,triangles.size())
+		{
+			Triangle &t=triangles[i];
+			loopj(0,3)
+			{
+				Vertex &v=vertices[t.v[j]];
+				refs[v.tstart+v.tcount].tid=i;
+				refs[v.tstart+v.tcount].tvertex=j;
+				v.tcount++;
+			}
+		}
+
+		// Identify boundary : vertices[].border=0,1
+		//
+		// A vertex is on the border if one of its edges is used by one triangle
+		// (open) or by three or more (non-manifold). Each vertex sorts the
+		// neighbour ids of its triangles; a run of equal ids is the number of
+		// triangles on that edge. This is O(n log n) in the valence and only
+		// writes the vertex itself, so vertices are done in parallel.
+		{
+			int nv=vertices.size();
+			OMP(omp parallel)
 			{
-				triangles[dst++]=triangles[i];
+				std::vector<int> ids;
+				OMP(omp for schedule(dynamic, 1024))
+				for (int i = 0; i < nv; i++)
+				{
+					Vertex &v=vertices[i];
+					ids.clear();
+					loopj(0,v.tcount)
+					{
+						const Ref &r=refs[v.tstart+j];
+						const Triangle &t=triangles[r.tid];
+						loopk(1,3) if(t.v[(r.tvertex+k)%3]!=i) ids.push_back(t.v[(r.tvertex+k)%3]);
+					}
+					std::sort(ids.begin(), ids.end());
+					int border=0;
+					for(size_t a=0; a<ids.size() && !border; )
+					{
+						size_t b=a+1;
+						while(b<ids.size() && ids[b]==ids[a]) b++;
+						if(b-a!=2) border=1;
+						a=b;
+					}
+					v.border=border;
+				}
 			}
-			triangles.resize(dst);
+			loopi(0,lockedVertexCount) vertices[i].border=BORDER_LOCKED;
 		}
+
 		//
 		// Init Quadrics by Plane & Edge Errors
 		//
@@ -900,141 +1868,803 @@ namespace Simplify
 		// recomputing during the simplification is not required,
 		// but mostly improves the result for closed meshes
 		//
-		if( iteration == 0 )
+		// Each vertex gathers the planes of its triangles in refs order, which is
+		// triangle order, so the sums do not depend on the number of threads.
+		//
+		int nt=triangles.size();
+		OMP(omp parallel for schedule(static))
+		for (int i = 0; i < nt; i++)
 		{
-			loopi(0,vertices.size())
-			vertices[i].q=SymetricMatrix(0.0);
+			Triangle &t=triangles[i];
+			vec3f n,p[3];
+			loopj(0,3) p[j]=vertices[t.v[j]].p;
+			n.cross(p[1]-p[0],p[2]-p[0]);
+			n.normalize();
+			t.n=n;
+		}
+#ifndef SIMPLIFY_MEMORYLESS
+		int nv=vertices.size();
+		OMP(omp parallel for schedule(static))
+		for (int i = 0; i < nv; i++)
+		{
+			Vertex &v=vertices[i];
+			SymetricMatrix q(0.0);
+			loopj(0,v.tcount)
+			{
+				const Triangle &t=triangles[refs[v.tstart+j].tid];
+				q=q+SymetricMatrix(t.n.x,t.n.y,t.n.z,-t.n.dot(vertices[t.v[0]].p));
+			}
+			v.q=q;
+		}
+		if(borderWeight > 0)
+		{
+			// An edge of v used by one triangle only is open; its constraint
+			// plane contains the edge and is perpendicular to the triangle
+			OMP(omp parallel)
+			{
+				std::vector<std::pair<int,int> > ids;
+				OMP(omp for schedule(dynamic, 1024))
+				for (int i = 0; i < nv; i++)
+				{
+					Vertex &v=vertices[i];
+					if(v.border!=1) continue;
+					ids.clear();
+					loopj(0,v.tcount)
+					{
+						const Ref &r=refs[v.tstart+j];
+						const Triangle &t=triangles[r.tid];
+						loopk(1,3) ids.push_back(std::make_pair(t.v[(r.tvertex+k)%3], r.tid));
+					}
+					std::sort(ids.begin(), ids.end());
+					for(size_t a=0; a<ids.size(); )
+					{
+						size_t b=a+1;
+						while(b<ids.size() && ids[b].first==ids[a].first) b++;
+						if(b-a==1)
+						{
+							const Triangle &t=triangles[ids[a].second];
+							vec3f n;
+							n.cross(vertices[ids[a].first].p-v.p, t.n);
+							n.normalize();
+							n=n*sqrt(borderWeight); // the quadric scales with the square
+							v.q+=SymetricMatrix(n.x,n.y,n.z,-n.dot(v.p));
+						}
+						a=b;
+					}
+				}
+			}
+		}
+#endif
+		OMP(omp parallel for schedule(static))
+		for (int i = 0; i < nt; i++)
+		{
+			// Calc Edge Error
+			Triangle &t=triangles[i];vec3f p;
+			loopj(0,3) t.err[j]=calculate_error(t.v[j],t.v[(j+1)%3],p);
+			t.err[3]=min(t.err[0],min(t.err[1],t.err[2]));
+		}
+	}
+
+	// Exclusive prefix sum of a[0..n) in place, returns the total.
+	// Fixed blocks keep the result independent of the number of threads.
+
+	int exclusive_scan(int *a, int n)
+	{
+		const int block=1<<14;
+		int nb=(n+block-1)/block;
+		scanBlocks.resize(nb);
+		OMP(omp parallel for schedule(static))
+		for (int b = 0; b < nb; b++)
+		{
+			int sum=0, end=min(n,(b+1)*block);
+			for (int i = b*block; i < end; i++) sum+=a[i];
+			scanBlocks[b]=sum;
+		}
+		int total=0;
+		loopi(0,nb) { int c=scanBlocks[i]; scanBlocks[i]=total; total+=c; }
+		OMP(omp parallel for schedule(static))
+		for (int b = 0; b < nb; b++)
+		{
+			int sum=scanBlocks[b], end=min(n,(b+1)*block);
+			for (int i = b*block; i < end; i++) { int c=a[i]; a[i]=sum; sum+=c; }
+		}
+		return total;
+	}
+
+	// Removes deleted triangles keeping their order.
+	// triangleRemap maps old ids to new ones, -1 for deleted triangles.
+
+	void compact_triangles()
+	{
+		int nt=triangles.size();
+		triangleRemap.resize(nt+1);
+		OMP(omp parallel for schedule(static))
+		for (int i = 0; i < nt; i++) triangleRemap[i]=!triangles[i].deleted;
+		int dst=exclusive_scan(&triangleRemap[0], nt);
+#ifdef _OPENMP
+		// scatter into the spare buffer, which keeps its capacity between calls
+		triangleScratch.resize(dst);
+		OMP(omp parallel for schedule(static))
+		for (int i = 0; i < nt; i++)
+		{
+			if(triangles[i].deleted) triangleRemap[i]=-1;
+			else triangleScratch[triangleRemap[i]]=triangles[i];
+		}
+		triangles.swap(triangleScratch);
+#else
+		// in place, the destination never passes the source
+		loopi(0,nt)
+		{
+			if(triangles[i].deleted) triangleRemap[i]=-1;
+			else triangles[triangleRemap[i]]=triangles[i];
+		}
+		triangles.resize(dst);
+#endif
+	}
+
+	// Finally compact mesh before exiting
+
+	void compact_mesh()
+	{
+		compact_triangles();
+		int nt=triangles.size(), nv=vertices.size();
+		vertexRemap.assign(nv+1,0);
+		OMP(omp parallel for schedule(static))
+		for (int i = 0; i < nt; i++)
+		{
+			const Triangle &t=triangles[i];
+			loopj(0,3)
+			{
+				OMP(omp atomic write)
+				vertexRemap[t.v[j]]=1;
+			}
+		}
+		int dst=exclusive_scan(&vertexRemap[0], nv);
+		vertexRemap[nv]=dst;
+		std::vector<vec3f> p(dst);
+		OMP(omp parallel for schedule(static))
+		for (int i = 0; i < nv; i++)
+			if(vertexRemap[i]<vertexRemap[i+1]) p[vertexRemap[i]]=vertices[i].p; // used
+		OMP(omp parallel for schedule(static))
+		for (int i = 0; i < nt; i++)
+		{
+			Triangle &t=triangles[i];
+			loopj(0,3)t.v[j]=vertexRemap[t.v[j]];
+		}
+		vertices.resize(dst);
+		OMP(omp parallel for schedule(static))
+		for (int i = 0; i < dst; i++) vertices[i].p=p[i];
+	}
+
+	// Spreads the low 21 bits of x to every third bit
+
+	inline unsigned long long morton_spread(unsigned long long x)
+	{
+		x&=0x1fffff;
+		x=(x|x<<32)&0x1f00000000ffffULL;
+		x=(x|x<<16)&0x1f0000ff0000ffULL;
+		x=(x|x<<8) &0x100f00f00f00f00fULL;
+		x=(x|x<<4) &0x10c30c30c30c30c3ULL;
+		x=(x|x<<2) &0x1249249249249249ULL;
+		return x;
+	}
+
+	// Optional pass after loading (-M): vertices are sorted by the Morton code
+	// of their position, then triangles by their smallest vertex id, so the
+	// refs and vertices a collapse touches are mostly close in memory.
+	// Ties keep the file order, so the result is deterministic.
+
+	void reorder_mesh()
+	{
+		int nv=vertices.size(), nt=triangles.size();
+		if(nv==0) return;
+		vec3f lo=vertices[0].p, hi=lo;
+		loopi(1,nv)
+		{
+			const vec3f &p=vertices[i].p;
+			lo.x=std::min(lo.x,p.x); lo.y=std::min(lo.y,p.y); lo.z=std::min(lo.z,p.z);
+			hi.x=std::max(hi.x,p.x); hi.y=std::max(hi.y,p.y); hi.z=std::max(hi.z,p.z);
+		}
+		double extent=std::max(hi.x-lo.x,std::max(hi.y-lo.y,hi.z-lo.z));
+		double scale=extent>0 ? 2097151.0/extent : 0;
+		std::vector<std::pair<unsigned long long,int> > key(nv);
+		OMP(omp parallel for schedule(static))
+		for (int i = 0; i < nv; i++)
+		{
+			const vec3f &p=vertices[i].p;
+			key[i].first=morton_spread((unsigned long long)((p.x-lo.x)*scale))
+				| morton_spread((unsigned long long)((p.y-lo.y)*scale))<<1
+				| morton_spread((unsigned long long)((p.z-lo.z)*scale))<<2;
+			key[i].second=i;
+		}
+		std::sort(key.begin(), key.end());
+		std::vector<int> remap(nv);
+		std::vector<Vertex> sorted(nv);
+		loopi(0,nv)
+		{
+			sorted[i]=vertices[key[i].second];
+			remap[key[i].second]=i;
+		}
+		vertices.swap(sorted);
+		free_vector(sorted);
+
+		std::vector<std::pair<int,int> > tkey(nt);
+		OMP(omp parallel for schedule(static))
+		for (int i = 0; i < nt; i++)
+		{
+			Triangle &t=triangles[i];
+			loopj(0,3) t.v[j]=remap[t.v[j]];
+			tkey[i].first=std::min(t.v[0],std::min(t.v[1],t.v[2]));
+			tkey[i].second=i;
+		}
+		std::sort(tkey.begin(), tkey.end());
+		std::vector<Triangle> tsorted(nt);
+		OMP(omp parallel for schedule(static))
+		for (int i = 0; i < nt; i++) tsorted[i]=triangles[tkey[i].second];
+		triangles.swap(tsorted);
+	}
 
-			loopi(0,triangles.size())
-			{
-				Triangle &t=triangles[i];
-				vec3f n,p[3];
-				loopj(0,3) p[j]=vertices[t.v[j]].p;
-				n.cross(p[1]-p[0],p[2]-p[0]);
-				n.normalize();
-				t.n=n;
-				loopj(0,3) vertices[t.v[j]].q =
-					vertices[t.v[j]].q+SymetricMatrix(n.x,n.y,n.z,-n.dot(p[0]));
-			}
-			loopi(0,triangles.size())
+	// Optional first stage for large reductions (-C): vertex clustering after
+	// Rossignac & Borrel on a uniform grid, refined until about target_vertices
+	// cells hold a vertex. The vertices of a cell merge into one, placed where
+	// the summed planes of their triangles meet if that lies near the cell, at
+	// their mean otherwise. Triangles left with fewer than three clusters, or
+	// with the same three as an earlier one, are removed.
+
+	void cluster_mesh(int target_vertices, bool verbose=false)
+	{
+		int nv=vertices.size(), nt=triangles.size();
+		if(target_vertices<4 || nv<=target_vertices) return;
+		vec3<double> lo=vertices[0].p, hi=lo;
+		loopi(1,nv)
+		{
+			const vec3f &p=vertices[i].p;
+			lo.x=std::min(lo.x,double(p.x)); lo.y=std::min(lo.y,double(p.y)); lo.z=std::min(lo.z,double(p.z));
+			hi.x=std::max(hi.x,double(p.x)); hi.y=std::max(hi.y,double(p.y)); hi.z=std::max(hi.z,double(p.z));
+		}
+		double extent=std::max(hi.x-lo.x,std::max(hi.y-lo.y,hi.z-lo.z));
+		if(!(extent>0)) return;
+
+		// a surface fills about res^2 of the res^3 cells; correct res from the count
+		std::vector<std::pair<unsigned long long,int> > key(nv);
+		double res=sqrt(double(target_vertices)), cell=0;
+		int clusters=0;
+		for(int round=0; round<6; round++)
+		{
+			res=std::min(std::max(res,1.0),2097151.0);
+			unsigned long long n=(unsigned long long)res;
+			cell=extent/n;
+			OMP(omp parallel for schedule(static))
+			for (int i = 0; i < nv; i++)
 			{
-				// Calc Edge Error
-				Triangle &t=triangles[i];vec3f p;
-				loopj(0,3) t.err[j]=calculate_error(t.v[j],t.v[(j+1)%3],p);
-				t.err[3]=min(t.err[0],min(t.err[1],t.err[2]));
+				const vec3f &p=vertices[i].p;
+				unsigned long long x=std::min(n-1,(unsigned long long)((p.x-lo.x)/cell));
+				unsigned long long y=std::min(n-1,(unsigned long long)((p.y-lo.y)/cell));
+				unsigned long long z=std::min(n-1,(unsigned long long)((p.z-lo.z)/cell));
+				key[i].first=(z*n+y)*n+x;
+				key[i].second=i;
 			}
+			std::sort(key.begin(), key.end());
+			clusters=0;
+			loopi(0,nv) if(i==0 || key[i].first!=key[i-1].first) clusters++;
+			if(verbose) printf("clustering: %llu cells per axis, %d clusters\n", n, clusters);
+			if(clusters>=target_vertices*0.8 && clusters<=target_vertices*1.25) break;
+			res*=sqrt(double(target_vertices)/clusters);
 		}
+		if(clusters>=nv) return;
 
-		// Init Reference ID list
-		loopi(0,vertices.size())
+		std::vector<int> cluster(nv);
+		int c=-1;
+		loopi(0,nv)
 		{
-			vertices[i].tstart=0;
-			vertices[i].tcount=0;
+			if(i==0 || key[i].first!=key[i-1].first) c++;
+			cluster[key[i].second]=c;
 		}
-		loopi(0,triangles.size())
+		free_vector(key);
+
+		// planes and mean of each cluster
+		std::vector<SymetricMatrixT<double> > q(clusters,SymetricMatrixT<double>(0.0));
+		std::vector<vec3<double> > mean(clusters,vec3<double>(0,0,0));
+		std::vector<int> count(clusters,0);
+		loopi(0,nv)
 		{
-			Triangle &t=triangles[i];
-			loopj(0,3) vertices[t.v[j]].tcount++;
+			mean[cluster[i]]=mean[cluster[i]]+vec3<double>(vertices[i].p);
+			count[cluster[i]]++;
 		}
-		int tstart=0;
-		loopi(0,vertices.size())
+		loopi(0,nt)
 		{
-			Vertex &v=vertices[i];
-			v.tstart=tstart;
-			tstart+=v.tcount;
-			v.tcount=0;
+			const Triangle &t=triangles[i];
+			vec3<double> p0=vertices[t.v[0]].p, p1=vertices[t.v[1]].p, p2=vertices[t.v[2]].p, n;
+			n.cross(p1-p0,p2-p0);
+			if(n.dot(n)==0) continue;
+			n.normalize();
+			SymetricMatrixT<double> plane(n.x,n.y,n.z,-n.dot(p0));
+			loopj(0,3) q[cluster[t.v[j]]]+=plane;
 		}
-
-		// Write References
-		refs.resize(triangles.size()*3);
-		loopi(0,triangles.size())
+		std::vector<Vertex> clustered(clusters);
+		OMP(omp parallel for schedule(static))
+		for (int i = 0; i < clusters; i++)
+		{
+			SymetricMatrixT<double> &m=q[i];
+			vec3<double> avg=mean[i]/count[i], p=avg;
+			double det=m.det(0, 1, 2, 1, 4, 5, 2, 5, 7);
+			if(det!=0 && fabs(det)>64*DBL_EPSILON*m[0]*m[4]*m[7])
+			{
+				vec3<double> x(-1/det*m.det(1, 2, 3, 4, 5, 6, 5, 7, 8),
+					1/det*m.det(0, 2, 3, 1, 5, 6, 2, 7, 8),
+					-1/det*m.det(0, 1, 3, 1, 4, 6, 2, 5, 8));
+				vec3<double> d=x-avg;
+				if(fabs(d.x)<=cell && fabs(d.y)<=cell && fabs(d.z)<=cell) p=x;
+			}
+			clustered[i].p=p;
+		}
+		free_vector(q);
+		free_vector(mean);
+		free_vector(count);
+
+		// remap, then drop collapsed and repeated triangles, keeping file order
+		std::vector<std::pair<std::pair<int,int>,std::pair<int,int> > > tkey(nt);
+		OMP(omp parallel for schedule(static))
+		for (int i = 0; i < nt; i++)
 		{
 			Triangle &t=triangles[i];
+			loopj(0,3) t.v[j]=cluster[t.v[j]];
+			t.deleted=(t.v[0]==t.v[1] || t.v[1]==t.v[2] || t.v[2]==t.v[0]);
+			int a=std::min(t.v[0],std::min(t.v[1],t.v[2])), b=std::max(t.v[0],std::max(t.v[1],t.v[2]));
+			tkey[i]=std::make_pair(std::make_pair(a,t.v[0]+t.v[1]+t.v[2]-a-b),std::make_pair(b,i));
+		}
+		std::sort(tkey.begin(), tkey.end());
+		loopi(1,nt) if(tkey[i].first==tkey[i-1].first && tkey[i].second.first==tkey[i-1].second.first)
+			triangles[tkey[i].second.second].deleted=1;
+		free_vector(tkey);
+		int dst=0;
+		loopi(0,nt) if(!triangles[i].deleted) triangles[dst++]=triangles[i];
+		triangles.resize(dst);
+		vertices.swap(clustered);
+	}
+
+	// Optional first stage for CAD meshes (-R): planar regions are rebuilt in
+	// one step instead of collapse by collapse. A region grows from the
+	// largest triangles over manifold edges while every vertex stays within
+	// tolerance*diagonal of the plane of its seed. If it is a disc, possibly
+	// with holes, its boundary loops are walked. Loop vertices on a straight
+	// run are dropped where only rebuilt regions use them, and the polygon
+	// left is ear-clipped into as few triangles as it has corners, less two,
+	// plus two per hole. Textured triangles are left as they are. Returns the
+	// number of regions rebuilt.
+
+	int retriangulate_planar(double tolerance, bool verbose=false)
+	{
+		int nt=triangles.size(), nv=vertices.size();
+		double tol=tolerance*bounding_diagonal();
+		if(nt==0 || !(tol>0)) return 0;
+		loopi(0,nt) triangles[i].deleted=0;
+		update_mesh(0); // refs and normals
+
+		// neighbour across each edge, -1 if open. Triangles without area,
+		// textured or on an edge that is non-manifold or inconsistently
+		// oriented join no region (-2).
+		std::vector<int> adj(nt*3,-1), region(nt,-1);
+		std::vector<std::pair<double,int> > order(nt);
+		OMP(omp parallel for schedule(static))
+		for (int i = 0; i < nt; i++)
+		{
+			const Triangle &t=triangles[i];
+			vec3<double> p0=vertices[t.v[0]].p, p1=vertices[t.v[1]].p, p2=vertices[t.v[2]].p, n;
+			n.cross(p1-p0,p2-p0);
+			order[i]=std::make_pair(-n.length(),i); // largest first
+			if(!(n.dot(n)>0) || (t.attr & TEXCOORD) == TEXCOORD) region[i]=-2;
 			loopj(0,3)
 			{
-				Vertex &v=vertices[t.v[j]];
-				refs[v.tstart+v.tcount].tid=i;
-				refs[v.tstart+v.tcount].tvertex=j;
-				v.tcount++;
+				int a=t.v[j], b=t.v[(j+1)%3], found=0;
+				// through the end with fewer triangles
+				const Vertex &v=vertices[vertices[a].tcount<=vertices[b].tcount ? a : b];
+				loopk(0,v.tcount)
+				{
+					const Ref &r=refs[v.tstart+k];
+					const Triangle &o=triangles[r.tid];
+					if(r.tid==i) continue;
+					int s=0;
+					while(s<3 && o.v[s]!=a) s++;
+					if(s==3) continue;
+					if(o.v[(s+2)%3]==b) { adj[i*3+j]=r.tid; found++; }
+					else if(o.v[(s+1)%3]==b) found+=2;
+				}
+				if(found>1) { adj[i*3+j]=-1; region[i]=-2; }
 			}
 		}
+		std::sort(order.begin(), order.end());
 
-		// Identify boundary : vertices[].border=0,1
-		if( iteration == 0 )
+		// grow the regions
+		std::vector<vec3<double> > normal;
+		std::vector<int> seed, stack;
+		loopi(0,nt)
 		{
-			std::vector<int> vcount,vids;
-
-			loopi(0,vertices.size())
-				vertices[i].border=0;
+			int s=order[i].second;
+			if(region[s]!=-1) continue;
+			const Triangle &ts=triangles[s];
+			vec3<double> p0=vertices[ts.v[0]].p, p1=vertices[ts.v[1]].p, p2=vertices[ts.v[2]].p, n;
+			n.cross(p1-p0,p2-p0);
+			n.normalize();
+			double d=n.dot(p0);
+			int r=seed.size();
+			seed.push_back(s);
+			normal.push_back(n);
+			region[s]=r;
+			stack.push_back(s);
+			while(!stack.empty())
+			{
+				int tid=stack.back();
+				stack.pop_back();
+				loopj(0,3)
+				{
+					int o=adj[tid*3+j];
+					if(o<0 || region[o]!=-1) continue;
+					const Triangle &t=triangles[o];
+					if(t.attr!=ts.attr || t.material!=ts.material) continue;
+					if(vec3<double>(t.n).dot(n)<0.5) continue; // cheap test first
+					bool inside=true;
+					loopk(0,3) if(fabs(n.dot(vec3<double>(vertices[t.v[k]].p))-d)>tol) inside=false;
+					if(!inside) continue;
+					region[o]=r;
+					stack.push_back(o);
+				}
+			}
+		}
+		free_vector(order);
+		int nr=seed.size();
+
+		// triangles of each region, in order
+		std::vector<int> rstart(nr+1,0), rtris;
+		loopi(0,nt) if(region[i]>=0) rstart[region[i]+1]++;
+		loopi(0,nr) rstart[i+1]+=rstart[i];
+		rtris.resize(rstart[nr]);
+		{
+			std::vector<int> fill(rstart.begin(), rstart.end()-1);
+			loopi(0,nt) if(region[i]>=0) rtris[fill[region[i]]++]=i;
+		}
 
-			loopi(0,vertices.size())
+		// boundary loops of each region that is a disc, possibly with holes:
+		// V-E+F = 2-loops and no vertex where the boundary touches itself
+		std::vector<char> valid(nr,0);
+		std::vector<int> rloop(nr+1,0), lstart(1,0), loops, out(nv), stampV(nv,-1), stampOut(nv,-1);
+		loopi(0,nr)
+		{
+			int faces=rstart[i+1]-rstart[i], verts=0, edges=0, length=0;
+			bool pinched=false;
+			for(int k=rstart[i]; k<rstart[i+1]; k++)
 			{
-				Vertex &v=vertices[i];
-				vcount.clear();
-				vids.clear();
-				loopj(0,v.tcount)
+				const Triangle &t=triangles[rtris[k]];
+				loopj(0,3)
+				{
+					int a=t.v[j], o=adj[rtris[k]*3+j];
+					if(stampV[a]!=i) { stampV[a]=i; verts++; }
+					if(o>=0 && region[o]==i) continue;
+					if(stampOut[a]==i) pinched=true;
+					stampOut[a]=i;
+					out[a]=t.v[(j+1)%3];
+					edges++;
+				}
+			}
+			rloop[i+1]=rloop[i];
+			if(pinched || edges==0) continue;
+			int first=loops.size();
+			for(int k=rstart[i]; k<rstart[i+1] && length<=edges; k++)
+			{
+				const Triangle &t=triangles[rtris[k]];
+				loopj(0,3)
+				{
+					int a=t.v[j];
+					if(stampOut[a]!=i) continue; // not on the boundary, or walked
+					do { stampOut[a]=-1; loops.push_back(a); a=out[a]; length++; } while(stampOut[a]==i && length<=edges);
+					lstart.push_back(loops.size());
+					rloop[i+1]++;
+				}
+			}
+			int count=rloop[i+1]-rloop[i];
+			if(length!=edges || verts-(3*faces+edges)/2+faces!=2-count)
+			{
+				loops.resize(first);
+				lstart.resize(lstart.size()-count);
+				rloop[i+1]=rloop[i];
+				continue;
+			}
+			valid[i]=1;
+		}
+		free_vector(out);
+		free_vector(stampOut);
+
+		// A loop vertex is fixed if a triangle that is not rebuilt uses it,
+		// and a corner if it is fixed or has other than two neighbours along
+		// the loops. Between corners the loops of two regions run alike, so the
+		// vertices kept there are chosen once per run (keep_run), in the same
+		// direction whichever region comes first. Regions whose polygon will
+		// not triangulate are left out, and the choice is made again.
+		std::vector<char> fixed(nv), nbCount(nv), keep(nv);
+		std::vector<int> nb(nv*2), run, polygon, pstart, runs, added;
+		for(;;)
+		{
+			loopi(0,nv) { fixed[i]=vertices[i].border==BORDER_LOCKED; nbCount[i]=0; }
+			loopi(0,nt) if(region[i]<0 || !valid[region[i]]) loopj(0,3) fixed[triangles[i].v[j]]=1;
+			loopi(0,nr) if(valid[i]) for(int q=rloop[i]; q<rloop[i+1]; q++)
+			{
+				int m=lstart[q+1]-lstart[q];
+				const int *l=&loops[lstart[q]];
+				loopj(0,m) loopk(0,2)
+				{
+					int a=l[(j+k)%m], b=l[(j+1-k)%m]; // each way
+					if(nbCount[a]>=1 && nb[a*2]==b) continue;
+					if(nbCount[a]>=2 && nb[a*2+1]==b) continue;
+					if(nbCount[a]<2) nb[a*2+nbCount[a]]=b;
+					nbCount[a]=std::min(nbCount[a]+1,3);
+				}
+			}
+			loopi(0,nv) keep[i]=fixed[i] || nbCount[i]!=2;
+			loopi(0,nr) if(valid[i]) for(int q=rloop[i]; q<rloop[i+1]; q++)
+			{
+				int m=lstart[q+1]-lstart[q];
+				const int *l=&loops[lstart[q]];
+				int f=0;
+				while(f<m && !keep[l[f]]) f++;
+				if(f==m) { loopj(0,m) keep[l[j]]=1; continue; } // no corner at all
+				for(int j=f; ; )
 				{
-					int k=refs[v.tstart+j].tid;
-					Triangle &t=triangles[k];
-					loopk(0,3)
+					run.clear();
+					run.push_back(l[j]);
+					int k=(j+1)%m;
+					while(!keep[l[k]]) { run.push_back(l[k]); k=(k+1)%m; }
+					run.push_back(l[k]);
+					if(run.front()>run.back() || (run.front()==run.back() && run[1]>run[run.size()-2]))
+						std::reverse(run.begin(), run.end());
+					keep_run(run, tol, keep);
+					j=k;
+					if(j==f) break;
+				}
+			}
+			added.clear();
+			bool failed=false;
+			int nruns=0;
+			loopi(0,nr) if(valid[i])
+			{
+				polygon.clear();
+				runs.clear();
+				pstart.assign(1,0);
+				for(int q=rloop[i]; q<rloop[i+1]; q++)
+				{
+					// stretches end at vertices fixed or shared with more regions;
+					// start the loop at one
+					int len=lstart[q+1]-lstart[q], f=0;
+					const int *l=&loops[lstart[q]];
+					while(f<len && !(keep[l[f]] && (fixed[l[f]] || nbCount[l[f]]!=2))) f++;
+					nruns++;
+					loopj(0,len)
 					{
-						int ofs=0,id=t.v[k];
-						while((size_t)ofs<vcount.size())
-						{
-							if(vids[ofs]==id)break;
-							ofs++;
-						}
-						if((size_t)ofs==vcount.size())
-						{
-							vcount.push_back(1);
-							vids.push_back(id);
-						}
-						else
-							vcount[ofs]++;
+						int v=l[(f+j)%len];
+						if(!keep[v]) continue;
+						if(j>0 && (fixed[v] || nbCount[v]!=2)) nruns++;
+						polygon.push_back(v);
+						runs.push_back(nruns);
 					}
+					pstart.push_back(polygon.size());
 				}
-				loopj(0,vcount.size()) if(vcount[j]==1)
-					vertices[vids[j]].border=1;
+				if(polygon.size()>PLANAR_MAX_LOOP || !triangulate_loops(polygon, pstart, runs, normal[i], tol, added))
+				{
+					valid[i]=0;
+					failed=true;
+				}
+			}
+			if(!failed) break;
+		}
+
+		// the new triangles of a region take the places of its first ones
+		int rebuilt=0, before=0, after=0;
+		for(int i=0, k=0; i<nr; i++) if(valid[i])
+		{
+			int m=0, holes=rloop[i+1]-rloop[i]-1;
+			for(int j=lstart[rloop[i]]; j<lstart[rloop[i+1]]; j++) if(keep[loops[j]]) m++;
+			int first=k*3, count=rstart[i+1]-rstart[i];
+			m+=2*holes-2; // triangles
+			k+=m;
+			if(m==count) continue; // no vertex dropped, kept as it is
+			Triangle t=triangles[seed[i]];
+			t.deleted=0;
+			t.dirty=0;
+			for(int j=rstart[i]; j<rstart[i+1]; j++) triangles[rtris[j]].deleted=1;
+			loopj(0,m)
+			{
+				for(int l=0; l<3; l++) t.v[l]=added[first+j*3+l];
+				triangles[rtris[rstart[i]+j]]=t; // m < count
 			}
+			rebuilt++;
+			before+=count;
+			after+=m;
 		}
+		if(verbose) printf("planar: %d regions, %d rebuilt, their %d triangles now %d\n", nr, rebuilt, before, after);
+		compact_mesh();
+		return rebuilt;
 	}
 
-	// Finally compact mesh before exiting
+	inline double cross2(double ax, double ay, double bx, double by, double cx, double cy)
+	{
+		return (bx-ax)*(cy-ay)-(by-ay)*(cx-ax);
+	}
 
-	void compact_mesh()
+	// Ear-clips a polygon given as loops of corners, counter-clockwise seen
+	// against n around the inside: an outer loop and clockwise holes, which
+	// are first joined to it by a bridge from their corner farthest along the
+	// projection's first axis (after Eberly). An ear must be more than tol
+	// high, and no other corner within tol of it. The triangles are appended
+	// to tris; returns false, tris unchanged, if no ear is left. runs[k] names
+	// the stretch of outline leaving corner k: a diagonal between two corners
+	// of one stretch is taken last, the region across it may take it too.
+
+	bool triangulate_loops(const std::vector<int> &corners, const std::vector<int> &starts, const std::vector<int> &runs,
+		const vec3<double> &n, double tol, std::vector<int> &tris)
 	{
-		int dst=0;
-		loopi(0,vertices.size())
+		int m=corners.size(), nl=int(starts.size())-1;
+		if(m<3) return false;
+		// project along the largest axis of the normal, mirrored if it points
+		// the other way, so the outer loop is counter-clockwise
+		int axis = fabs(n.x)>fabs(n.y) ? (fabs(n.x)>fabs(n.z) ? 0 : 2) : (fabs(n.y)>fabs(n.z) ? 1 : 2);
+		double sign = (axis==0 ? n.x : axis==1 ? n.y : n.z)<0 ? -1 : 1;
+		std::vector<double> u(m), w(m);
+		loopi(0,m)
 		{
-			vertices[i].tcount=0;
+			vec3<double> p=vertices[corners[i]].p;
+			double c[3]={p.x,p.y,p.z};
+			u[i]=sign*c[(axis+1)%3];
+			w[i]=c[(axis+2)%3];
 		}
-		loopi(0,triangles.size())
-		if(!triangles[i].deleted)
+		// the outer loop is the one of positive area; the holes go in by
+		// their largest u first
+		int outer=-1;
+		std::vector<std::pair<double,int> > holes;
+		loopi(0,nl)
 		{
-			Triangle &t=triangles[i];
-			triangles[dst++]=t;
-			loopj(0,3)vertices[t.v[j]].tcount=1;
+			double area=0, umax=-DBL_MAX;
+			int right=starts[i];
+			for(int j=starts[i]; j<starts[i+1]; j++)
+			{
+				int k = j+1<starts[i+1] ? j+1 : starts[i];
+				area+=u[j]*w[k]-u[k]*w[j];
+				if(u[j]>umax) { umax=u[j]; right=j; }
+			}
+			if(area>0) { if(outer>=0) return false; outer=i; }
+			else holes.push_back(std::make_pair(-umax,right));
 		}
-		triangles.resize(dst);
-		dst=0;
-		loopi(0,vertices.size())
-		if(vertices[i].tcount)
+		if(outer<0) return false;
+		std::sort(holes.begin(), holes.end());
+		std::vector<int> poly;
+		for(int j=starts[outer]; j<starts[outer+1]; j++) poly.push_back(j);
+		loopi(0,holes.size())
 		{
-			vertices[i].tstart=dst;
-			vertices[dst].p=vertices[i].p;
-			dst++;
+			int h=holes[i].second, l=0;
+			while(starts[l+1]<=h) l++;
+			// nearest crossing of the ray from h along +u with an edge going up
+			int best=-1;
+			double bx=DBL_MAX;
+			loopj(0,poly.size())
+			{
+				int p=poly[j], q=poly[(j+1)%poly.size()];
+				if(!(w[p]<=w[h] && w[h]<=w[q] && w[p]<w[q])) continue;
+				double x=u[p]+(w[h]-w[p])*(u[q]-u[p])/(w[q]-w[p]);
+				if(x<u[h] || x>=bx) continue;
+				bx=x;
+				best = u[p]>u[q] ? j : (j+1)%poly.size();
+			}
+			if(best<0) return false;
+			// a corner inside the triangle h, crossing, poly[best] hides it;
+			// take the one nearest in angle to the ray then
+			int mp=poly[best];
+			double tan0=DBL_MAX, du0=DBL_MAX;
+			loopj(0,poly.size())
+			{
+				int p=poly[j];
+				if(corners[p]==corners[mp]) continue;
+				double d0=cross2(u[h],w[h], bx,w[h], u[p],w[p]);
+				double d1=cross2(bx,w[h], u[mp],w[mp], u[p],w[p]);
+				double d2=cross2(u[mp],w[mp], u[h],w[h], u[p],w[p]);
+				if((d0<0 || d1<0 || d2<0) && (d0>0 || d1>0 || d2>0)) continue;
+				double du=u[p]-u[h], tan=fabs(w[p]-w[h])/du;
+				if(!(du>0)) continue;
+				if(tan<tan0 || (tan==tan0 && du<du0)) { tan0=tan; du0=du; best=j; }
+			}
+			// bridge: ..., m, h, rest of the hole, h, m, ...
+			std::vector<int> hole;
+			int len=starts[l+1]-starts[l];
+			loopj(0,len+1) hole.push_back(starts[l]+(h-starts[l]+j)%len);
+			hole.push_back(poly[best]);
+			poly.insert(poly.begin()+best+1, hole.begin(), hole.end());
 		}
-		loopi(0,triangles.size())
+
+		// the stretch into each corner
+		std::vector<int> into(m);
+		loopi(0,nl) for(int k=starts[i]; k<starts[i+1]; k++) into[k]=runs[k>starts[i] ? k-1 : starts[i+1]-1];
+
+		m=poly.size();
+		std::vector<int> prev(m), next(m);
+		loopi(0,m) { prev[i]=(i+m-1)%m; next[i]=(i+1)%m; }
+		// clip the best shaped ear each time, one without a diagonal along a
+		// stretch if there is: the first found leaves slivers along the outline
+		size_t first=tris.size();
+		for(int left=m; left>=3; left--)
 		{
-			Triangle &t=triangles[i];
-			loopj(0,3)t.v[j]=vertices[t.v[j]].tstart;
+			int best=-1, i=0, r0=2;
+			double q0=0;
+			while(prev[i]<0) i++;
+			for(int k=0; k<left; k++, i=next[i])
+			{
+				int a=prev[i], c=next[i];
+				int pa=poly[a], pi=poly[i], pc=poly[c];
+				if(corners[pa]==corners[pc]) continue;
+				double ai2=(u[pi]-u[pa])*(u[pi]-u[pa])+(w[pi]-w[pa])*(w[pi]-w[pa]);
+				double ic2=(u[pc]-u[pi])*(u[pc]-u[pi])+(w[pc]-w[pi])*(w[pc]-w[pi]);
+				double ca2=(u[pa]-u[pc])*(u[pa]-u[pc])+(w[pa]-w[pc])*(w[pa]-w[pc]);
+				// edge lengths times tol: the cross products below are lengths
+				// times distances
+				double ai=tol*sqrt(ai2), ic=tol*sqrt(ic2), ca=tol*sqrt(ca2);
+				double area=(u[pi]-u[pa])*(w[pc]-w[pa])-(w[pi]-w[pa])*(u[pc]-u[pa]);
+				int r = left>3 && (runs[pa]==into[pc] || runs[pc]==into[pa]);
+				if(area<=ca || r>r0 || (r==r0 && area<=q0*(ai2+ic2+ca2))) continue;
+				// no other corner inside the triangle a,i,c or near it; the copies
+				// of a bridge's ends are the corners themselves
+				bool ear=true;
+				if(left>3) for(int j=next[c]; ear && j!=a; j=next[j])
+				{
+					int pj=poly[j];
+					if(corners[pj]==corners[pa] || corners[pj]==corners[pi] || corners[pj]==corners[pc]) continue;
+					if((u[pi]-u[pa])*(w[pj]-w[pa])-(w[pi]-w[pa])*(u[pj]-u[pa])<-ai) continue;
+					if((u[pc]-u[pi])*(w[pj]-w[pi])-(w[pc]-w[pi])*(u[pj]-u[pi])<-ic) continue;
+					if((u[pa]-u[pc])*(w[pj]-w[pc])-(w[pa]-w[pc])*(u[pj]-u[pc])<-ca) continue;
+					ear=false;
+				}
+				if(ear) { q0=area/(ai2+ic2+ca2); r0=r; best=i; }
+			}
+			if(best<0) { tris.resize(first); return false; }
+			int a=prev[best], c=next[best];
+			tris.push_back(corners[poly[a]]); tris.push_back(corners[poly[best]]); tris.push_back(corners[poly[c]]);
+			next[a]=c;
+			prev[c]=a;
+			prev[best]=-1;
+			if(left==3) break;
+		}
+		return true;
+	}
+
+	// Douglas-Peucker on a run of loop vertices between two corners: keeps
+	// the vertex farthest from the segment between the ends, if farther than
+	// tol, and goes on with both halves. The ends are kept already.
+
+	void keep_run(const std::vector<int> &run, double tol, std::vector<char> &keep)
+	{
+		std::vector<std::pair<int,int> > spans(1,std::make_pair(0,int(run.size())-1));
+		while(!spans.empty())
+		{
+			int lo=spans.back().first, hi=spans.back().second;
+			spans.pop_back();
+			vec3<double> a=vertices[run[lo]].p, b=vertices[run[hi]].p, d=b-a;
+			double len2=d.dot(d), far2=tol*tol;
+			int far=-1;
+			for(int i=lo+1; i<hi; i++)
+			{
+				vec3<double> e=vec3<double>(vertices[run[i]].p)-a, c;
+				double s = len2>0 ? e.dot(d)/len2 : 0, dist2;
+				if(s<=0) dist2=e.dot(e);
+				else if(s>=1) dist2=(e-d).dot(e-d);
+				else { c.cross(e,d); dist2=c.dot(c)/len2; }
+				if(dist2>far2) { far2=dist2; far=i; }
+			}
+			if(far<0) continue;
+			keep[run[far]]=1;
+			spans.push_back(std::make_pair(lo,far));
+			spans.push_back(std::make_pair(far,hi));
 		}
-		vertices.resize(dst);
 	}
 
+#ifndef SIMPLIFY_MEMORYLESS
 	// Error between vertex and Quadric
 
-	double vertex_error(SymetricMatrix q, double x, double y, double z)
+	QReal vertex_error(SymetricMatrix q, QReal x, QReal y, QReal z)
 	{
  		return   q[0]*x*x + 2*q[1]*x*y + 2*q[2]*x*z + 2*q[3]*x + q[4]*y*y
  		     + 2*q[5]*y*z + 2*q[6]*y + q[7]*z*z + 2*q[8]*z + q[9];
@@ -1042,15 +2672,18 @@ namespace Simplify
 
 	// Error for one edge
 
-	double calculate_error(int id_v1, int id_v2, vec3f &p_result)
+	QReal calculate_error(int id_v1, int id_v2, vec3f &p_result)
 	{
 		// compute interpolated vertex
 
 		SymetricMatrix q = vertices[id_v1].q + vertices[id_v2].q;
 		bool   border = vertices[id_v1].border & vertices[id_v2].border;
-		double error=0;
-		double det = q.det(0, 1, 2, 1, 4, 5, 2, 5, 7);
-		if ( det != 0 && !border )
+		QReal error=0;
+		QReal det = q.det(0, 1, 2, 1, 4, 5, 2, 5, 7);
+		// below the rounding noise of QReal the solve is singular in effect;
+		// det <= q[0]*q[4]*q[7] for a quadric
+		QReal noise = 64*std::numeric_limits<QReal>::epsilon()*q[0]*q[4]*q[7];
+		if ( !keepEndpoints && det != 0 && fabs(det) > noise && (!border || borderWeight > 0) )
 		{
 
 			// q_delta is invertible
@@ -1066,9 +2699,9 @@ namespace Simplify
 			vec3f p1=vertices[id_v1].p;
 			vec3f p2=vertices[id_v2].p;
 			vec3f p3=(p1+p2)/2;
-			double error1 = vertex_error(q, p1.x,p1.y,p1.z);
-			double error2 = vertex_error(q, p2.x,p2.y,p2.z);
-			double error3 = vertex_error(q, p3.x,p3.y,p3.z);
+			QReal error1 = vertex_error(q, p1.x,p1.y,p1.z);
+			QReal error2 = vertex_error(q, p2.x,p2.y,p2.z);
+			QReal error3 = keepEndpoints ? std::numeric_limits<QReal>::max() : vertex_error(q, p3.x,p3.y,p3.z);
 			error = min(error1, min(error2, error3));
 			if (error1 == error) p_result=p1;
 			if (error2 == error) p_result=p2;
@@ -1076,6 +2709,201 @@ namespace Simplify
 		}
 		return error;
 	}
+#else
+	// Memoryless collapse costs (Lindstrom & Turk): no quadric is kept per
+	// vertex, both 1-rings are read afresh from refs. The new position meets,
+	// in this order and each only in the directions the earlier ones leave
+	// free: volume preservation, boundary area preservation, volume
+	// optimization, boundary optimization and shape optimization. The cost is
+	// the summed squared volume swept by the triangles plus the squared area
+	// swept by open edges times the edge length squared; its cube root is
+	// returned, a squared length like the quadric error.
+
+	typedef vec3<double> vec3d;
+
+	inline vec3d cross(const vec3d &a, const vec3d &b) { vec3d c; c.cross(a,b); return c; }
+
+	// Up to three linear constraints a[i].v = b[i]; a new one is dropped if it
+	// is within about a degree of the span of those already taken
+	struct LTConstraints
+	{
+		vec3d a[3];
+		double b[3];
+		int n;
+
+		LTConstraints() : n(0) {}
+
+		void add(const vec3d &ai, double bi)
+		{
+			const double cos2 = 0.99969541, sin2 = 1-cos2; // 1 degree
+			double l2=ai.dot(ai);
+			if(n==3 || l2==0) return;
+			if(n==1) { double d=a[0].dot(ai); if(d*d >= l2*cos2) return; }
+			if(n==2) { vec3d c=cross(a[0],a[1]); double d=c.dot(ai); if(d*d <= c.dot(c)*l2*sin2) return; }
+			double l=sqrt(l2);
+			a[n]=ai/l; b[n]=bi/l; n++;
+		}
+
+		// minimum of v.Hv/2 + c.v in the free directions; H is symmetric
+		void add_minimum(const vec3d H[3], const vec3d &c)
+		{
+			if(n==0)
+			{
+				add(H[0],-c.x); add(H[1],-c.y); add(H[2],-c.z);
+			}
+			else if(n==1)
+			{
+				const vec3d &a0=a[0];
+				vec3d q0 = a0.x==0 ? vec3d(0,-a0.z,a0.y) : a0.y==0 ? vec3d(-a0.z,0,a0.x) : vec3d(-a0.y,a0.x,0);
+				vec3d q1 = cross(a0,q0);
+				add(times(H,q0),-q0.dot(c));
+				add(times(H,q1),-q1.dot(c));
+			}
+			else if(n==2)
+			{
+				vec3d q=cross(a[0],a[1]);
+				add(times(H,q),-q.dot(c));
+			}
+		}
+
+		bool solve(vec3d &v) const
+		{
+			if(n<3) return false;
+			vec3d c0=cross(a[1],a[2]), c1=cross(a[2],a[0]), c2=cross(a[0],a[1]);
+			double det=a[0].dot(c0);
+			if(det==0) return false;
+			v=(c0*b[0]+c1*b[1]+c2*b[2])/det;
+			return true;
+		}
+
+		static vec3d times(const vec3d H[3], const vec3d &q) { return vec3d(H[0].dot(q),H[1].dot(q),H[2].dot(q)); }
+	};
+
+	// sum of squared volumes or areas as a quadratic form: v.Hv + 2c.v + k
+	struct LTForm
+	{
+		vec3d H[3], c;
+		double k;
+
+		LTForm() : c(0,0,0), k(0) { H[0]=H[1]=H[2]=vec3d(0,0,0); }
+
+		// (n.v - d)^2
+		void add_plane(const vec3d &n, double d)
+		{
+			H[0]=H[0]+n*n.x; H[1]=H[1]+n*n.y; H[2]=H[2]+n*n.z;
+			c=c-n*d; k+=d*d;
+		}
+
+		// |e x v + f|^2
+		void add_edge(const vec3d &e, const vec3d &f)
+		{
+			double e2=e.dot(e);
+			H[0]=H[0]+vec3d(e2,0,0)-e*e.x; H[1]=H[1]+vec3d(0,e2,0)-e*e.y; H[2]=H[2]+vec3d(0,0,e2)-e*e.z;
+			c=c+cross(f,e); k+=f.dot(f);
+		}
+
+		double at(const vec3d &v) const
+		{
+			return v.dot(LTConstraints::times(H,v)) + 2*c.dot(v) + k;
+		}
+	};
+
+	// Does any other live triangle around a use the edge (a,b)?
+	bool shared_edge(int a, int b, int tid)
+	{
+		const Vertex &v=vertices[a];
+		loopk(0,v.tcount)
+		{
+			const Ref &r=refs[v.tstart+k];
+			const Triangle &t=triangles[r.tid];
+			if(t.deleted || r.tid==tid) continue;
+			if(t.v[(r.tvertex+1)%3]==b || t.v[(r.tvertex+2)%3]==b) return true;
+		}
+		return false;
+	}
+
+	// Every edge around a vertex reads its whole 1-ring; edges of larger rings
+	// than this wait until collapses nearby have brought the valence down
+	enum { LT_MAX_RING = 512 };
+
+	QReal calculate_error(int id_v1, int id_v2, vec3f &p_result)
+	{
+		if(vertices[id_v1].tcount+vertices[id_v2].tcount > LT_MAX_RING)
+		{
+			p_result=vertices[id_v1].p;
+			return std::numeric_limits<QReal>::max();
+		}
+		const double volumeWeight = 0.5, boundaryWeight = 0.5;
+		LTForm volume, boundary;
+		vec3d normals(0,0,0), edges(0,0,0), edgesCross(0,0,0), links(0,0,0);
+		double volumes = 0;
+		int linkCount = 0;
+		const int ids[2] = { id_v1, id_v2 };
+		loopi(0,2)
+		{
+			const Vertex &v=vertices[ids[i]];
+			loopk(0,v.tcount)
+			{
+				const Ref &r=refs[v.tstart+k];
+				const Triangle &t=triangles[r.tid];
+				if(t.deleted) continue;
+				int s=r.tvertex, b=t.v[(s+1)%3], c=t.v[(s+2)%3];
+				vec3d p0=vertices[ids[i]].p, p1=vertices[b].p, p2=vertices[c].p;
+				// open edges (a,b) and (c,a), each once
+				if(v.border)
+				{
+					if(!(i==1 && b==id_v1) && !shared_edge(ids[i],b,r.tid))
+					{
+						vec3d e=p1-p0, f=cross(p0,p1);
+						boundary.add_edge(e,f); edges=edges+e; edgesCross=edgesCross+f;
+					}
+					if(!(i==1 && c==id_v1) && !shared_edge(ids[i],c,r.tid))
+					{
+						vec3d e=p0-p2, f=cross(p2,p0);
+						boundary.add_edge(e,f); edges=edges+e; edgesCross=edgesCross+f;
+					}
+				}
+				// triangles of the edge itself once
+				if(i==1 && (b==id_v1 || c==id_v1)) continue;
+				vec3d n=cross(p1-p0,p2-p0);
+				double d=n.dot(p0);
+				volume.add_plane(n,d);
+				normals=normals+n; volumes+=d;
+				if(b!=id_v1 && b!=id_v2) { links=links+p1; linkCount++; }
+				if(c!=id_v1 && c!=id_v2) { links=links+p2; linkCount++; }
+			}
+		}
+
+		LTConstraints lc;
+		lc.add(normals,volumes);
+		if(lc.n<3)
+		{
+			double e2=edges.dot(edges);
+			vec3d H[3] = { vec3d(e2,0,0)-edges*edges.x, vec3d(0,e2,0)-edges*edges.y, vec3d(0,0,e2)-edges*edges.z };
+			lc.add_minimum(H,cross(edgesCross,edges));
+		}
+		if(lc.n<3) lc.add_minimum(volume.H,volume.c);
+		if(lc.n<3) lc.add_minimum(boundary.H,boundary.c);
+		if(lc.n<3 && linkCount)
+		{
+			vec3d H[3] = { vec3d(linkCount,0,0), vec3d(0,linkCount,0), vec3d(0,0,linkCount) };
+			lc.add_minimum(H,links*-1.0);
+		}
+		vec3d p1=vertices[id_v1].p, p2=vertices[id_v2].p, v;
+		double length2=(p2-p1).dot(p2-p1);
+		if(keepEndpoints)
+		{
+			double cost1=volumeWeight*volume.at(p1)/36 + boundaryWeight*boundary.at(p1)/4*length2;
+			double cost2=volumeWeight*volume.at(p2)/36 + boundaryWeight*boundary.at(p2)/4*length2;
+			v = cost2<cost1 ? p2 : p1;
+		}
+		else if(!lc.solve(v)) v=(p1+p2)/2;
+		p_result=v;
+		v=p_result; // cost at the position as stored
+		double cost=volumeWeight*volume.at(v)/36 + boundaryWeight*boundary.at(v)/4*length2;
+		return cbrt(std::max(cost,0.0));
+	}
+#endif
 
 	char *trimwhitespace(char *str)
 	{
@@ -1111,6 +2939,13 @@ namespace Simplify
 			printf ( "File %s not found!\n" ,filename );
 			return;
 		}
+		// about 80 bytes per vertex and its two triangles in a typical obj;
+		// unused reserve is never touched, so overestimating is cheap
+		size_t bytes = file_size(fn);
+		vertices.reserve(bytes/64);
+		triangles.reserve(bytes/32);
+		advise_huge_pages(vertices);
+		advise_huge_pages(triangles);
 		char line[1000];
 		memset ( line,0,1000 );
 		int vertex_cnt = 0;
@@ -1118,6 +2953,7 @@ namespace Simplify
 		std::map<std::string, int> material_map;
 		std::vector<vec3f> uvs;
 		std::vector<std::vector<int> > uvMap;
+		double xyz[3];
 		int line_index = 0;
 		while(fgets( line, 1000, fn ) != NULL)
 		{
@@ -1143,15 +2979,16 @@ namespace Simplify
 			{
 				if ( line[2] == ' ' ) {
 				if(sscanf(line,"vt %lf %lf",
-					&uv.x,&uv.y)==2)
+					&xyz[0],&xyz[1])==2)
 				{
-					uv.z = 0;
+					uv = vec3f(xyz[0],xyz[1],0);
 					uvs.push_back(uv);
 				}
 				} else {
 				if(sscanf(line,"vt %lf %lf %lf",
-					&uv.x,&uv.y,&uv.z)==3)
+					&xyz[0],&xyz[1],&xyz[2])==3)
 				{
+					uv = vec3f(xyz[0],xyz[1],xyz[2]);
 					uvs.push_back(uv);
 				}
 				}
@@ -1160,8 +2997,9 @@ namespace Simplify
 			{
 				if ( line[1] == ' ' )
 				if(sscanf(line,"v %lf %lf %lf",
-					&v.p.x,	&v.p.y,	&v.p.z)==3)
+					&xyz[0], &xyz[1], &xyz[2])==3)
 				{
+					v.p = vec3f(xyz[0],xyz[1],xyz[2]);
 					vertices.push_back(v);
 				}
 			}
@@ -1291,6 +3129,12 @@ namespace Simplify
 		}
 		vertices.clear();
 		triangles.clear();
+		// one triangle of 9 or 10 numbers per line, about 100 bytes
+		size_t bytes = file_size(fn);
+		triangles.reserve(bytes/96);
+		vertices.reserve(3*(bytes/96));
+		advise_huge_pages(vertices);
+		advise_huge_pages(triangles);
 		int line_index = 0;
 		const bool useNsquared = false; // user decide
 		const bool useNlogN = false; // user decide
@@ -1298,24 +3142,29 @@ namespace Simplify
 		while (fgets(line, 1000, fn) != NULL) {
 			Triangle t;
 			Vertex v0, v1, v2;
+			double xyz[9];
 			double quality; // quality is the 10th number and is ignored
 			bool sscanfcondition;
 			if (is12char) {
 				sscanfcondition = (sscanf(line, "%12lf%12lf%12lf%12lf%12lf%12lf%12lf%12lf%12lf%12lf", 
-					&v0.p.x, &v0.p.y, &v0.p.z,
-					&v1.p.x, &v1.p.y, &v1.p.z,
-					&v2.p.x, &v2.p.y, &v2.p.z, &quality) >= 9);
+					&xyz[0], &xyz[1], &xyz[2],
+					&xyz[3], &xyz[4], &xyz[5],
+					&xyz[6], &xyz[7], &xyz[8], &quality) >= 9);
 			} else {
 				sscanfcondition = (sscanf(line, "%lf %lf %lf %lf %lf %lf %lf %lf %lf %lf", 
-					&v0.p.x, &v0.p.y, &v0.p.z,
-					&v1.p.x, &v1.p.y, &v1.p.z,
-					&v2.p.x, &v2.p.y, &v2.p.z, &quality) >= 9);
+					&xyz[0], &xyz[1], &xyz[2],
+					&xyz[3], &xyz[4], &xyz[5],
+					&xyz[6], &xyz[7], &xyz[8], &quality) >= 9);
 			}
 			// if (sscanf(line, "%lf %lf %lf %lf %lf %lf %lf %lf %lf %lf", // originally
 			//         &v0.p.x, &v0.p.y, &v0.p.z,
 			//         &v1.p.x, &v1.p.y, &v1.p.z,
 			//         &v2.p.x, &v2.p.y, &v2.p.z, &quality) >= 9) {
 			if (sscanfcondition) {
+				// read as double, stored at the engine's precision
+				v0.p = vec3f(xyz[0], xyz[1], xyz[2]);
+				v1.p = vec3f(xyz[3], xyz[4], xyz[5]);
+				v2.p = vec3f(xyz[6], xyz[7], xyz[8]);
 				if (useNsquared) {
 					// Find vertex from container of vertices, and use existing vertex if found
 					bool v0Missing = true, v1Missing = true, v2Missing = true;
@@ -1401,6 +3250,7 @@ namespace Simplify
 
 			// Insertion of vertices into hashtable
 			std::unordered_map<Vertex, size_t, hashFunc, equalsFunc> setVertices;
+			setVertices.reserve(vertices.size()/2);
 			std::vector<Vertex>::iterator vitr = vertices.begin();
 			for (size_t i = 0; i < vertices.size(); i++) {
 				if(setVertices.insert(std::make_pair(vertices[i], std::distance(vertices.begin(), vitr))).second) {
@@ -1556,7 +3406,7 @@ namespace Simplify
 		def_region.regionTarget = 0.5;
 		def_region.regionBound = false;
 		def_region.func = constantFunc;
-		def_region.coord = vec3f(0.0, 0.0, 0.0);
+		def_region.coord = vec3<double>(0.0, 0.0, 0.0);
 		def_region.radius = 1.0;
 		def_region.scale = 1.0;
 		def_region.power = 1.0;
@@ -1564,23 +3414,25 @@ namespace Simplify
 		def_region.done = false;
 		def_region.startCount = 0;
 		def_region.endCount = 0;
+		def_region.reach = 0;
+		def_region.outsideFactor = 1;
+		init_region_falloff(def_region);
 		char line[1000];
 		memset(line, 0, 1000);
 		std::vector<char*> line_argv;
 		int line_count = 0;
 		while (fgets(line, 1000, fn) != NULL) {
 			line_count++;
-			char opt_exists;
-			char arg_exists;
 			currentRegion = def_region;
 			line_argv.clear();
-			char* pch = strtok(line, " ");
-			if ((pch[0] == '-') && (sscanf(line," %s %s ", &opt_exists, &arg_exists)==2)) {
-				while (pch != NULL) {
-					line_argv.push_back(pch);
-					pch = strtok(NULL, " ");
-				}
-				for (std::vector<char*>::iterator it = line_argv.begin(); it != line_argv.end(); ++it) {
+			char* pch = strtok(line, " \t\r\n");
+			while (pch != NULL) {
+				line_argv.push_back(pch);
+				pch = strtok(NULL, " \t\r\n");
+			}
+			if ((line_argv.size() >= 2) && (line_argv[0][0] == '-')) {
+				// every option takes one argument
+				for (std::vector<char*>::iterator it = line_argv.begin(); it+1 != line_argv.end(); ++it) {
 					if (strncmp(*it, "-q", 2) == 0) {
 						if ((atof(*(it+1)) <= 1) && (atof(*(it+1)) > 0))
 							currentRegion.regionTarget = atof(*(it+1));
@@ -1604,7 +3456,7 @@ namespace Simplify
 							coord_arr[i] = atof(pcoord);
 							pcoord = strtok(NULL, "{[( ,)]}");
 						}
-						currentRegion.coord = vec3f(coord_arr[0], coord_arr[1], coord_arr[2]);
+						currentRegion.coord = vec3<double>(coord_arr[0], coord_arr[1], coord_arr[2]);
 					} else if (strncmp(*it, "-r", 2) == 0) {
 						currentRegion.radius = atof(*(it+1));
 					} else if (strncmp(*it, "-s", 2) == 0) {
@@ -1617,6 +3469,7 @@ namespace Simplify
 						}
 					}
 				}
+				init_region_falloff(currentRegion);
 				regions.push_back(currentRegion);
 				
 				// printf final regions if verbose
@@ -1633,15 +3486,17 @@ namespace Simplify
 						function_str = "constantFunc";
 					}
 					if (currentRegion.isNegative) isNegative_str = "true"; else isNegative_str = "false";
-					printf("line interpreted: -T %lf -f %s -c %lf,%lf,%lf -r %lf -s %lf -p %lf -n %s",
+					printf("line interpreted: -%c %lf -f %s -c %lf,%lf,%lf -r %lf -s %lf -p %lf -n %s\n",
+					currentRegion.regionBound ? 'Q' : 'q',
 					currentRegion.regionTarget, function_str.c_str(), currentRegion.coord.x,
 					currentRegion.coord.y, currentRegion.coord.z, currentRegion.radius, currentRegion.scale,
 					currentRegion.power, isNegative_str.c_str());
 				}
 			} else if (verbose) {
-				printf("line #%d not loaded: \"%.*s ...\"", line_count, 150, line);
+				printf("line #%d not loaded: \"%.*s ...\"\n", line_count, 150, line);
 			}
 		}
+		fclose(fn);
 		return EXIT_SUCCESS;
 	} //load_txt
 	
@@ -1649,37 +3504,205 @@ namespace Simplify
 	bool inRegion(Triangle &t, double coord[], double radius) {
 		bool allin = true;
 		for (int i = 0; i < 3; i++) {
-    		allin = allin && (pow(vertices[t.v[i]].p.x-coord[0], 2.0) + pow(vertices[t.v[i]].p.y-coord[1], 2.0) + pow(vertices[t.v[i]].p.z-coord[2], 2.0) <= radius*radius);
+			const vec3f &p = vertices[t.v[i]].p;
+			allin = allin && sphere_inside(p.x, p.y, p.z, coord[0], coord[1], coord[2], radius);
 		}
 		return allin;
     }
 
-	// Computes the factor to threshold locked to a region
-	double thresholdRegionsBound(Triangle &t, double &threshold0) {
-		double squareFactor;
-		for (std::vector<Region>::iterator it = regions.begin(); it != regions.end(); it++) {
-			squareFactor = square(vertices[t.v[0]].p.x, vertices[t.v[0]].p.y, 
-			vertices[t.v[0]].p.z, (*it).coord.x, (*it).coord.y, (*it).coord.z,
-			(*it).radius, (*it).scale, (*it).isNegative);
-			if (squareFactor == 0) {
-				return 0;
-			} else {
-				threshold0 = threshold0 * pow((*it).func(vertices[t.v[0]].p.x, vertices[t.v[0]].p.y, 
-				vertices[t.v[0]].p.z, (*it).coord.x, (*it).coord.y, (*it).coord.z,
-				(*it).radius, (*it).scale, (*it).isNegative), (*it).power) * squareFactor;
+	// Threshold factors of n positions for FACTOR_SINGLE
+	void vertex_factors_n(const double *x, const double *y, const double *z, int n, double *out) {
+		falloff_n(factorFunc.falloff, x, y, z, n, out);
+		loopi(0, n) out[i] = pow(out[i], factorFunc.power);
+	}
+
+	// Threshold factor at p for the current factorMode
+	double vertex_factor(const vec3f &p) {
+		if (factorMode != FACTOR_SINGLE) return region_grid_factor(p);
+		double x = p.x, y = p.y, z = p.z, out;
+		vertex_factors_n(&x, &y, &z, 1, &out);
+		return out;
+	}
+
+	void init_vertex_factors() {
+		if (factorMode == FACTOR_NONE) {
+			vertexFactor.clear();
+			return;
+		}
+		vertexFactor.resize(vertices.size());
+		int n = int(vertices.size());
+		if (factorMode != FACTOR_SINGLE) {
+			std::vector<int> order, blockStart, blockCell;
+			region_cell_blocks(order, blockStart, blockCell);
+			int nb = int(blockCell.size());
+			OMP(omp parallel for schedule(dynamic, 16))
+			for (int b = 0; b < nb; b++) {
+				double x[FALLOFF_BLOCK], y[FALLOFF_BLOCK], z[FALLOFF_BLOCK], out[FALLOFF_BLOCK], tmp[2*FALLOFF_BLOCK];
+				const int *ids = &order[blockStart[b]];
+				int count = blockStart[b+1] - blockStart[b];
+				loopi(0, count) {
+					const vec3f &p = vertices[ids[i]].p;
+					x[i] = p.x; y[i] = p.y; z[i] = p.z;
+				}
+				region_factors_n(blockCell[b], x, y, z, count, out, tmp);
+				loopi(0, count) vertexFactor[ids[i]] = out[i];
+			}
+			return;
+		}
+		OMP(omp parallel for schedule(static))
+		for (int start = 0; start < n; start += FALLOFF_BLOCK) {
+			double x[FALLOFF_BLOCK], y[FALLOFF_BLOCK], z[FALLOFF_BLOCK];
+			int count = std::min(FALLOFF_BLOCK, n - start);
+			loopi(0, count) {
+				const vec3f &p = vertices[start+i].p;
+				x[i] = p.x; y[i] = p.y; z[i] = p.z;
 			}
+			vertex_factors_n(x, y, z, count, &vertexFactor[start]);
+		}
+	}
+
+	// Multiplies out[i] by the factor of one region (-L) at position i; tmp holds
+	// 2n. constantFunc regions leave the threshold unchanged.
+	void region_factor_n(const Region &r, const double *x, const double *y, const double *z, int n, double *out, double *tmp) {
+		double *f = tmp, *b = tmp + n;
+		if (r.falloff.kind != FALLOFF_CONSTANT) {
+			falloff_n(r.falloff, x, y, z, n, f);
+			loopi(0, n) f[i] = pow(f[i], r.power);
+		} else loopi(0, n) f[i] = 1.0;
+		if (factorMode == FACTOR_REGIONS_BOUND) {
+			falloff_n(r.bound, x, y, z, n, b);
+			loopi(0, n) f[i] = (b[i] == 0) ? 0 : f[i]*b[i];
+		}
+		loopi(0, n) out[i] *= f[i];
+	}
+
+	// Factors of n positions that all lie in grid cell c (-1: outside the grid),
+	// the product over the regions that reach the cell; tmp holds 2n
+	void region_factors_n(int c, const double *x, const double *y, const double *z, int n, double *out, double *tmp) {
+		const RegionGrid &g = regionGrid;
+		int zeroSeen = 0;
+		if (c >= 0) for (int k = g.cellStart[c]; k < g.cellStart[c+1]; k++) if (regions[g.cellRegions[k]].outsideFactor == 0) zeroSeen++;
+		if (zeroSeen < g.zeroOutside) { // outside a region whose factor vanishes away from it
+			loopi(0, n) out[i] = 0;
+			return;
+		}
+		loopi(0, n) out[i] = 1.0;
+		loopk(0, int(g.unbounded.size())) region_factor_n(regions[g.unbounded[k]], x, y, z, n, out, tmp);
+		if (c >= 0) for (int k = g.cellStart[c]; k < g.cellStart[c+1]; k++) region_factor_n(regions[g.cellRegions[k]], x, y, z, n, out, tmp);
+	}
+
+	// Threshold factor at p for -L, evaluating only the regions that reach p
+	double region_grid_factor(const vec3f &p) {
+		double x = p.x, y = p.y, z = p.z, out, tmp[2];
+		region_factors_n(region_grid_cell(p), &x, &y, &z, 1, &out, tmp);
+		return out;
+	}
+
+	// Vertex ids grouped by grid cell, those outside the grid first, and cut into
+	// blocks of at most FALLOFF_BLOCK within one cell: block b is
+	// order[blockStart[b]] to order[blockStart[b+1]-1], all in cell blockCell[b]
+	void region_cell_blocks(std::vector<int> &order, std::vector<int> &blockStart, std::vector<int> &blockCell) {
+		const RegionGrid &g = regionGrid;
+		int n = int(vertices.size()), ncells = g.nx*g.ny*g.nz;
+		std::vector<int> cell(n), start(ncells + 2, 0);
+		OMP(omp parallel for schedule(static))
+		for (int i = 0; i < n; i++) cell[i] = region_grid_cell(vertices[i].p) + 1;
+		loopi(0, n) start[cell[i]+1]++;
+		loopi(0, ncells + 1) start[i+1] += start[i];
+		order.resize(n);
+		blockStart.clear();
+		blockCell.clear();
+		loopi(0, ncells + 1) for (int b = start[i]; b < start[i+1]; b += FALLOFF_BLOCK) {
+			blockStart.push_back(b);
+			blockCell.push_back(i - 1);
 		}
-		return threshold0;
+		blockStart.push_back(n);
+		loopi(0, n) order[start[cell[i]]++] = i;
+	}
+
+	int region_grid_cell(const vec3f &p) {
+		const RegionGrid &g = regionGrid;
+		if (g.nx == 0) return -1;
+		double fx = floor((p.x - g.lo.x) / g.cell), fy = floor((p.y - g.lo.y) / g.cell), fz = floor((p.z - g.lo.z) / g.cell);
+		if (fx < 0 || fy < 0 || fz < 0 || fx >= g.nx || fy >= g.ny || fz >= g.nz) return -1;
+		return (int(fz)*g.ny + int(fy))*g.nx + int(fx);
 	}
 
-	// Computes the factor to threshold of all vertices corresponding to the position of triangle (1st vertex)
-	double thresholdAllCenters(Triangle &t, double &threshold0) {
-		for (std::vector<Region>::iterator it = regions.begin(); it != regions.end(); it++) {
-			threshold0 = threshold0 * pow((*it).func(vertices[t.v[0]].p.x, vertices[t.v[0]].p.y, 
-			vertices[t.v[0]].p.z, (*it).coord.x, (*it).coord.y, (*it).coord.z,
-			(*it).radius, (*it).scale, (*it).isNegative), (*it).power);
+	// Sets reach and outsideFactor of every region and bins the bounded ones into regionGrid
+	void build_region_grid() {
+		RegionGrid &g = regionGrid;
+		g.nx = g.ny = g.nz = 0;
+		g.cellStart.clear();
+		g.cellRegions.clear();
+		g.unbounded.clear();
+		g.zeroOutside = 0;
+		const double big = DBL_MAX;
+		vec3<double> lo(big, big, big), hi(-big, -big, -big);
+		double reachSum = 0;
+		int local = 0;
+		loopi(0, regions.size()) {
+			Region &r = regions[i];
+			const Falloff &f = r.falloff;
+			r.reach = fabs(r.radius);
+			if (f.kind == FALLOFF_GAUSSIAN) {
+				// 1-exp(-d^2*k) rounds to 1 once d^2*k > 40; the negative form never becomes constant
+				if (r.isNegative || !(f.k > 0)) r.reach = -1;
+				else r.reach = std::max(r.reach, sqrt(40.0/f.k));
+			} else if (f.kind == FALLOFF_TRIANGULAR) {
+				r.reach = std::max(r.reach, sqrt(f.radius2));
+			}
+			r.outsideFactor = (f.kind == FALLOFF_CONSTANT) ? 1.0 : pow(f.outside, r.power);
+			if (factorMode == FACTOR_REGIONS_BOUND) r.outsideFactor = (r.bound.outside == 0) ? 0 : r.outsideFactor*r.bound.outside;
+			if (r.reach < 0) {
+				g.unbounded.push_back(i);
+				continue;
+			}
+			// pad for rounding in the distance tests
+			r.reach += 1e-9*(r.reach + fabs(r.coord.x) + fabs(r.coord.y) + fabs(r.coord.z));
+			lo = vec3<double>(std::min(lo.x, r.coord.x - r.reach), std::min(lo.y, r.coord.y - r.reach), std::min(lo.z, r.coord.z - r.reach));
+			hi = vec3<double>(std::max(hi.x, r.coord.x + r.reach), std::max(hi.y, r.coord.y + r.reach), std::max(hi.z, r.coord.z + r.reach));
+			reachSum += r.reach;
+			if (r.outsideFactor == 0) g.zeroOutside++;
+			local++;
+		}
+		if (!local) return;
+		// cells about one reach wide, at most 256 per axis and 2M in total
+		double extent = std::max(hi.x - lo.x, std::max(hi.y - lo.y, hi.z - lo.z));
+		g.lo = lo;
+		g.cell = std::max(reachSum/local, extent/256);
+		if (!(g.cell > 0)) g.cell = 1.0;
+		for (;;) {
+			g.nx = int((hi.x - lo.x) / g.cell) + 1;
+			g.ny = int((hi.y - lo.y) / g.cell) + 1;
+			g.nz = int((hi.z - lo.z) / g.cell) + 1;
+			if (double(g.nx)*g.ny*g.nz <= double(1 << 21)) break;
+			g.cell *= 2;
+		}
+		int ncells = g.nx*g.ny*g.nz;
+		// count, prefix sum, scatter
+		g.cellStart.assign(ncells + 1, 0);
+		loopk(0, 2) {
+			loopi(0, regions.size()) {
+				const Region &r = regions[i];
+				if (r.reach < 0) continue;
+				int x0 = std::max(0, int(floor((r.coord.x - r.reach - lo.x) / g.cell))), x1 = std::min(g.nx-1, int(floor((r.coord.x + r.reach - lo.x) / g.cell)));
+				int y0 = std::max(0, int(floor((r.coord.y - r.reach - lo.y) / g.cell))), y1 = std::min(g.ny-1, int(floor((r.coord.y + r.reach - lo.y) / g.cell)));
+				int z0 = std::max(0, int(floor((r.coord.z - r.reach - lo.z) / g.cell))), z1 = std::min(g.nz-1, int(floor((r.coord.z + r.reach - lo.z) / g.cell)));
+				for (int z = z0; z <= z1; z++) for (int y = y0; y <= y1; y++) for (int x = x0; x <= x1; x++) {
+					int c = (z*g.ny + y)*g.nx + x;
+					if (k == 0) g.cellStart[c+1]++;
+					else g.cellRegions[g.cellStart[c]++] = i;
+				}
+			}
+			if (k == 0) {
+				loopi(0, ncells) g.cellStart[i+1] += g.cellStart[i];
+				g.cellRegions.resize(g.cellStart[ncells]);
+			} else {
+				// scatter advanced every start to the next cell's
+				for (int i = ncells; i > 0; i--) g.cellStart[i] = g.cellStart[i-1];
+				g.cellStart[0] = 0;
+			}
 		}
-		return threshold0;
 	}
 
 	int currentCountInRegion(Region &region0) {
@@ -1700,20 +3723,173 @@ namespace Simplify
 	}
 
 	int currentCountOutsideAllRegions() {
-		return Simplify::initialTotalCount - Simplify::initialRegionCount - currentCountInAllRegions();
+		return initialTotalCount - initialRegionCount - currentCountInAllRegions();
 	}
 
 	bool allRegionsDone() {
 		bool allDone = true;
 		loopi(0, int(regions.size())) {
 			if (!regions[i].done) {
-				regions[i].endCount = currentCountInRegion(regions[i]);
-				regions[i].done = ((double(regions[i].endCount)/regions[i].startCount) <= regions[i].regionTarget);
+				regions[i].done = (regions[i].startCount == 0) || ((double(regions[i].endCount)/regions[i].startCount) <= regions[i].regionTarget);
 			}
 			allDone = (allDone && regions[i].done);
 			if (!allDone) break;
 		}
 		return allDone;
     }
+
+	// For n positions in grid cell c (-1: outside the grid), n <= FALLOFF_BLOCK:
+	// sets bit r of bits[i*regionWords...] if position i lies inside regions[r]
+	void region_bits_n(int c, const double *x, const double *y, const double *z, int n, unsigned long long *bits) {
+		const RegionGrid &g = regionGrid;
+		unsigned char inside[FALLOFF_BLOCK];
+		loopi(0, n*regionWords) bits[i] = 0;
+		int nu = int(g.unbounded.size()), nk = c >= 0 ? g.cellStart[c+1] - g.cellStart[c] : 0;
+		loopk(0, nu + nk) {
+			int id = k < nu ? g.unbounded[k] : g.cellRegions[g.cellStart[c] + k - nu];
+			const Region &r = regions[id];
+			sphere_inside_n(x, y, z, n, r.coord.x, r.coord.y, r.coord.z, r.radius, inside);
+			loopi(0, n) if (inside[i]) bits[i*regionWords+(id>>6)] |= 1ULL << (id&63);
+		}
+	}
+
+	// Sets bit r of bits if p lies inside regions[r]
+	void region_bits(const vec3f &p, unsigned long long *bits) {
+		double x = p.x, y = p.y, z = p.z;
+		region_bits_n(region_grid_cell(p), &x, &y, &z, 1, bits);
+	}
+
+	// Computes every vertex's membership once and counts the triangles inside each region
+	void init_region_counters() {
+		build_region_grid();
+		regionWords = (int(regions.size()) + 63) / 64;
+		regionBits.assign(vertices.size()*regionWords, 0);
+		regionScratch.assign(regionWords, 0);
+		std::vector<int> order, blockStart, blockCell;
+		region_cell_blocks(order, blockStart, blockCell);
+		int nb = int(blockCell.size());
+		OMP(omp parallel)
+		{
+			std::vector<unsigned long long> bits(FALLOFF_BLOCK*regionWords);
+			OMP(omp for schedule(dynamic, 16))
+			for (int b = 0; b < nb; b++) {
+				double x[FALLOFF_BLOCK], y[FALLOFF_BLOCK], z[FALLOFF_BLOCK];
+				const int *ids = &order[blockStart[b]];
+				int count = blockStart[b+1] - blockStart[b];
+				loopi(0, count) {
+					const vec3f &p = vertices[ids[i]].p;
+					x[i] = p.x; y[i] = p.y; z[i] = p.z;
+				}
+				region_bits_n(blockCell[b], x, y, z, count, &bits[0]);
+				loopi(0, count) loopj(0, regionWords) regionBits[ids[i]*regionWords+j] = bits[i*regionWords+j];
+			}
+		}
+		loopi(0, int(regions.size())) regions[i].endCount = 0;
+		loopi(0, int(triangles.size())) if (!triangles[i].deleted) count_region_triangle(triangles[i], 1);
+	}
+
+	// Adds delta to endCount of every region holding all three vertices of t.
+	// If i0bits is given, it replaces the stored membership of vertex i0.
+	void count_region_triangle(const Triangle &t, int delta, int i0, const unsigned long long *i0bits) {
+		loopi(0, regionWords) {
+			unsigned long long mask = ~0ULL;
+			loopj(0, 3) {
+				if (i0bits && t.v[j] == i0) mask &= i0bits[i];
+				else mask &= regionBits[t.v[j]*regionWords+i];
+			}
+			for (int b = i*64; mask; b++, mask >>= 1) if (mask & 1) regions[b].endCount += delta;
+		}
+	}
+
+	bool region_vertex_inside(int vid, int region) {
+		return (regionBits[vid*regionWords+(region>>6)] & (1ULL << (region&63))) != 0;
+	}
+
+	bool region_triangle_inside(const Triangle &t, int region) {
+		unsigned long long bit = 1ULL << (region&63);
+		int w = region>>6;
+		return (regionBits[t.v[0]*regionWords+w] & regionBits[t.v[1]*regionWords+w] & regionBits[t.v[2]*regionWords+w] & bit) != 0;
+	}
+
+	// This instance under one name, so a caller can be written once as a
+	// template over the engine and run at any precision (see Main.cpp).
+	struct Engine
+	{
+		typedef SIMPLIFY_NAMESPACE::Region Region;
+#ifdef SIMPLIFY_MEMORYLESS
+		static const char *name() { return sizeof(Real)==sizeof(float) ? "memoryless, float" : "memoryless, double"; }
+#else
+		static const char *name() { return sizeof(Real)==sizeof(QReal) ? (sizeof(Real)==sizeof(float) ? "float" : "double") : "mixed"; }
+#endif
+		static size_t vertex_bytes() { return sizeof(Vertex); }
+		static size_t triangle_bytes() { return sizeof(Triangle); }
+
+		static std::vector<Triangle> &triangles;
+		static std::vector<Vertex> &vertices;
+		static std::vector<Region> &regions;
+		static double &target_region_ratio, &target_outside_ratio;
+		static double &currentRegionRatio, &currentOutsideRatio;
+		static int &consecutiveNoDeletionThreshold;
+		static int &initialTotalCount, &initialRegionCount, &currentRegionCount;
+		static bool &regionDone, &hugePages, &stoppedEarly;
+		static double &maxError, &collapseErrorMax, &collapseErrorSum, &adaptiveFraction, &heapMargin, &borderWeight, &losslessTolerance;
+		static int &collapseCount, &stallPasses;
+		static double bounding_diagonal() { return SIMPLIFY_NAMESPACE::bounding_diagonal(); }
+
+		static void load_obj(const char *f, bool verbose, int lines) { SIMPLIFY_NAMESPACE::load_obj(f, verbose, lines); }
+		static void load_tri10(const char *f, bool verbose, int lines) { SIMPLIFY_NAMESPACE::load_tri10(f, verbose, lines); }
+		static int load_txt(const char *f, bool verbose) { return SIMPLIFY_NAMESPACE::load_txt(f, verbose); }
+		static void write_obj(const char *f, bool verbose, int lines) { SIMPLIFY_NAMESPACE::write_obj(f, verbose, lines); }
+		static void write_tri10(const char *f, bool verbose, int lines) { SIMPLIFY_NAMESPACE::write_tri10(f, verbose, lines); }
+		static void write_tri9(const char *f, bool verbose, int lines) { SIMPLIFY_NAMESPACE::write_tri9(f, verbose, lines); }
+		static void reorder_mesh() { SIMPLIFY_NAMESPACE::reorder_mesh(); }
+		static void set_deadline_ms(double ms) { SIMPLIFY_NAMESPACE::set_deadline_ms(ms); }
+		static void cluster_mesh(int target_vertices, bool verbose) { SIMPLIFY_NAMESPACE::cluster_mesh(target_vertices, verbose); }
+		static int retriangulate_planar(double tolerance, bool verbose) { return SIMPLIFY_NAMESPACE::retriangulate_planar(tolerance, verbose); }
+		static bool inRegion(Triangle &t, double coord[], double radius) { return SIMPLIFY_NAMESPACE::inRegion(t, coord, radius); }
+
+		static void simplify_mesh(double coord[3], int target_count, double agressiveness, bool verbose,
+			double (*func)(double, double, double, double, double, double, double, double, bool),
+			double radius, double scale, double power, bool isneg, bool doRegionSimplification, bool doMultipleCenters)
+		{
+			SIMPLIFY_NAMESPACE::simplify_mesh(coord, target_count, agressiveness, verbose, func, radius, scale, power, isneg,
+				doRegionSimplification, doMultipleCenters);
+		}
+		static void simplify_mesh_lossless(bool verbose) { SIMPLIFY_NAMESPACE::simplify_mesh_lossless(verbose); }
+		static bool simplify_region_only(double coord[3], double region_ratio, double agressiveness, bool verbose,
+			double (*func)(double, double, double, double, double, double, double, double, bool),
+			double radius, double scale, double power, bool isneg)
+		{
+			return SIMPLIFY_NAMESPACE::simplify_region_only(coord, region_ratio, agressiveness, verbose, func, radius, scale, power, isneg);
+		}
+	};
+	std::vector<Triangle> &Engine::triangles = SIMPLIFY_NAMESPACE::triangles;
+	std::vector<Vertex> &Engine::vertices = SIMPLIFY_NAMESPACE::vertices;
+	std::vector<Region> &Engine::regions = SIMPLIFY_NAMESPACE::regions;
+	double &Engine::target_region_ratio = SIMPLIFY_NAMESPACE::target_region_ratio;
+	double &Engine::target_outside_ratio = SIMPLIFY_NAMESPACE::target_outside_ratio;
+	double &Engine::currentRegionRatio = SIMPLIFY_NAMESPACE::currentRegionRatio;
+	double &Engine::currentOutsideRatio = SIMPLIFY_NAMESPACE::currentOutsideRatio;
+	int &Engine::consecutiveNoDeletionThreshold = SIMPLIFY_NAMESPACE::consecutiveNoDeletionThreshold;
+	int &Engine::initialTotalCount = SIMPLIFY_NAMESPACE::initialTotalCount;
+	int &Engine::initialRegionCount = SIMPLIFY_NAMESPACE::initialRegionCount;
+	int &Engine::currentRegionCount = SIMPLIFY_NAMESPACE::currentRegionCount;
+	bool &Engine::regionDone = SIMPLIFY_NAMESPACE::regionDone;
+	bool &Engine::hugePages = SIMPLIFY_NAMESPACE::hugePages;
+	bool &Engine::stoppedEarly = SIMPLIFY_NAMESPACE::stoppedEarly;
+	double &Engine::maxError = SIMPLIFY_NAMESPACE::maxError;
+	double &Engine::adaptiveFraction = SIMPLIFY_NAMESPACE::adaptiveFraction;
+	double &Engine::heapMargin = SIMPLIFY_NAMESPACE::heapMargin;
+	double &Engine::borderWeight = SIMPLIFY_NAMESPACE::borderWeight;
+	double &Engine::losslessTolerance = SIMPLIFY_NAMESPACE::losslessTolerance;
+	double &Engine::collapseErrorMax = SIMPLIFY_NAMESPACE::collapseErrorMax;
+	double &Engine::collapseErrorSum = SIMPLIFY_NAMESPACE::collapseErrorSum;
+	int &Engine::collapseCount = SIMPLIFY_NAMESPACE::collapseCount;
+	int &Engine::stallPasses = SIMPLIFY_NAMESPACE::stallPasses;
 };
 ///////////////////////////////////////////
+
+#undef SIMPLIFY_NAMESPACE
+#undef SIMPLIFY_POSITION
+#undef SIMPLIFY_QUADRIC
+#undef SIMPLIFY_MEMORYLESS
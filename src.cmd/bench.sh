@@ -0,0 +1,60 @@
+#!/bin/sh
+# Timing driver for the command line tool. Generates two test meshes and
+# prints, for each binary and mesh, the best simplification time of several
+# runs (the time on the Output line). To compare two builds:
+#   g++ Main.cpp -O3 -o simplify_old   (at the older commit)
+#   g++ Main.cpp -O3 -o simplify_new
+#   ./bench.sh "./simplify_old ./simplify_new" "-t 0.05"
+# Meshes, written once to $BENCH_DIR (default /tmp/simplify_bench):
+#   sphere.obj  UV sphere, 480000 triangles, closed
+#   grid.obj    height field, 320000 triangles, open
+# RUNS sets the number of runs per binary and mesh (default 5).
+
+bins=${1:-./simplify}
+flags=${2:--t 0.05}
+runs=${RUNS:-5}
+dir=${BENCH_DIR:-/tmp/simplify_bench}
+mkdir -p "$dir" || exit 1
+
+if [ ! -f "$dir/sphere.obj" ]; then
+    awk -v nu=800 -v nv=301 'BEGIN {
+        pi = 3.14159265358979;
+        print "v 0 0 1";
+        for (j = 1; j < nv; j++) for (i = 0; i < nu; i++) {
+            t = pi*j/nv; p = 2*pi*i/nu;
+            printf "v %.7f %.7f %.7f\n", sin(t)*cos(p), sin(t)*sin(p), cos(t);
+        }
+        print "v 0 0 -1";
+        last = 2 + nu*(nv-1);
+        for (i = 0; i < nu; i++) printf "f 1 %d %d\n", 2+i, 2+(i+1)%nu;
+        for (j = 1; j < nv-1; j++) for (i = 0; i < nu; i++) {
+            a = 2 + (j-1)*nu + i; b = 2 + (j-1)*nu + (i+1)%nu;
+            printf "f %d %d %d\nf %d %d %d\n", a, a+nu, b+nu, a, b+nu, b;
+        }
+        for (i = 0; i < nu; i++) printf "f %d %d %d\n", last, 2+(nv-2)*nu+(i+1)%nu, 2+(nv-2)*nu+i;
+    }' > "$dir/sphere.obj"
+fi
+if [ ! -f "$dir/grid.obj" ]; then
+    awk -v n=400 'BEGIN {
+        for (j = 0; j <= n; j++) for (i = 0; i <= n; i++)
+            printf "v %d %d %.7f\n", i, j, 2*sin(i*0.05)*cos(j*0.07) + 0.3*sin(i*0.3+j*0.2);
+        for (j = 0; j < n; j++) for (i = 0; i < n; i++) {
+            a = 1 + j*(n+1) + i;
+            printf "f %d %d %d\nf %d %d %d\n", a, a+1, a+n+2, a, a+n+2, a+n+1;
+        }
+    }' > "$dir/grid.obj"
+fi
+
+for mesh in sphere grid; do
+    for bin in $bins; do
+        best=
+        r=0
+        while [ $r -lt $runs ]; do
+            t=$($bin $flags "$dir/$mesh.obj" "$dir/out.obj" | sed -n 's/^Output:.*; \([0-9.]*\) sec.*/\1/p')
+            if [ -z "$t" ]; then echo "$bin failed on $mesh.obj"; exit 1; fi
+            best=$(echo "$t $best" | awk '{ print ($2 == "" || $1 < $2) ? $1 : $2 }')
+            r=$((r+1))
+        done
+        echo "$mesh.obj $bin $flags: best of $runs $best sec"
+    done
+done